@@ -4,9 +4,9 @@
 #
 #-------------------------------------------------
 
-QT       += core gui widgets
+QT       += core gui widgets concurrent
 CONFIG   += c++11
-lessThan(QT_MAJOR_VERSION, 5): error("requires Qt 5")
+lessThan(QT_MAJOR_VERSION, 5)|if(equals(QT_MAJOR_VERSION, 5):lessThan(QT_MINOR_VERSION, 12)): error("requires Qt 5.12")
 
 TARGET = QJsonModel
 TEMPLATE = app
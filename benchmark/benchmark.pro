@@ -0,0 +1,17 @@
+QT += testlib core concurrent
+QT -= gui
+
+CONFIG += qt console warn_on depend_includepath testcase
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+SOURCES += \
+   ../qjsonmodel.cpp \
+   tst_qjsonmodelbench.cpp
+
+HEADERS += \
+   ../qjsonmodel.h
+
+INCLUDEPATH += \
+   $$PWD/..
@@ -0,0 +1,706 @@
+#include <QSortFilterProxyModel>
+#include <QtTest>
+
+#include "qjsonmodel.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+#include <malloc.h>
+#define HAVE_MALLINFO2
+#endif
+
+class QJsonModelBench : public QObject
+{
+   Q_OBJECT
+
+private slots:
+   void parent_data();
+   void parent();
+   void json_data();
+   void json();
+   void escape_data();
+   void escape();
+   void numbers_data();
+   void numbers();
+   void ids_data();
+   void ids();
+   void objectKeys_data();
+   void objectKeys();
+   void load_data();
+   void load();
+   void loadMemory_data();
+   void loadMemory();
+   void arrayMemory();
+   void loadClear_data();
+   void loadClear();
+   void snapshot_data();
+   void snapshot();
+   void binaryFormats_data();
+   void binaryFormats();
+   void parallelLoad_data();
+   void parallelLoad();
+   void pointer_data();
+   void pointer();
+   void search_data();
+   void search();
+   void filter_data();
+   void filter();
+   void query_data();
+   void query();
+};
+
+
+static qint64 heapInUse()
+{
+#ifdef HAVE_MALLINFO2
+   return qint64(mallinfo2().uordblks);
+#else
+   return -1;
+#endif
+}
+
+/// Resets the peak resident size of the process, which Linux allows from 4.0.
+static bool resetPeakMemory()
+{
+#ifdef Q_OS_LINUX
+   QFile file("/proc/self/clear_refs");
+   return file.open(QIODevice::WriteOnly) && file.write("5") == 1;
+#else
+   return false;
+#endif
+}
+
+/// A size from /proc/self/status, such as "VmHWM:", in bytes, or -1.
+static qint64 processMemory(const char* field)
+{
+   QFile file("/proc/self/status");
+   if (!file.open(QIODevice::ReadOnly)) {
+      return -1;
+   }
+   for (const QByteArray& line : file.readAll().split('\n')) {
+      if (line.startsWith(field)) {
+         return line.mid(int(qstrlen(field))).simplified().split(' ').first().toLongLong() * 1024;
+      }
+   }
+   return -1;
+}
+
+static QByteArray largeArray(int count)
+{
+   QByteArray json;
+   json.reserve(count * 8);
+   json += '[';
+   for (int i = 0; i < count; ++i) {
+      if (i > 0) {
+         json += ',';
+      }
+      json += '[';
+      json += QByteArray::number(i);
+      json += ']';
+   }
+   json += ']';
+   return json;
+}
+
+static QByteArray records(int count)
+{
+   QByteArray json;
+   json.reserve(count * 96);
+   json += '[';
+   for (int i = 0; i < count; ++i) {
+      if (i > 0) {
+         json += ',';
+      }
+      json += "{\"id\":" + QByteArray::number(i)
+            + ",\"name\":\"record " + QByteArray::number(i)
+            + "\",\"value\":" + QByteArray::number(i * 0.25)
+            + ",\"active\":" + (i % 2 ? "true" : "false")
+            + ",\"tags\":[\"alpha\",\"beta\"],\"parent\":null}";
+   }
+   json += ']';
+   return json;
+}
+
+static QByteArray wideObject(int count)
+{
+   QByteArray json;
+   json.reserve(count * 16);
+   json += "[{";
+   for (int i = 0; i < count; ++i) {
+      if (i > 0) {
+         json += ',';
+      }
+      json += "\"key" + QByteArray::number(i) + "\":" + QByteArray::number(i);
+   }
+   json += "}]";
+   return json;
+}
+
+void QJsonModelBench::parent_data()
+{
+   QTest::addColumn<int>("count");
+
+   QTest::newRow("1k") << 1000;
+   QTest::newRow("10k") << 10000;
+   QTest::newRow("200k") << 200000;
+}
+
+void QJsonModelBench::parent()
+{
+   QFETCH(int, count);
+
+   QJsonModel model;
+   QVERIFY(model.loadFromRaw(largeArray(count)));
+
+   QModelIndexList children;
+   children.reserve(count);
+   for (int row = 0; row < count; ++row) {
+      children.append(model.index(0, 0, model.index(row, 0)));
+   }
+
+   QBENCHMARK {
+      for (const auto& child : children) {
+         model.parent(child);
+      }
+   }
+}
+
+void QJsonModelBench::json_data()
+{
+   QTest::addColumn<int>("count");
+   QTest::addColumn<bool>("compact");
+   QTest::addColumn<bool>("tree");
+
+   // "document" only measures QJsonDocument::toJson() of an already built
+   // document, i.e. the second half of exporting through a QJsonValue
+   for (int count : {10000, 50000}) {
+      for (bool compact : {true, false}) {
+         const QByteArray name = QByteArray::number(count) + (compact ? " compact" : " indented");
+         QTest::newRow((name + " tree").constData()) << count << compact << true;
+         QTest::newRow((name + " document").constData()) << count << compact << false;
+      }
+   }
+}
+
+void QJsonModelBench::json()
+{
+   QFETCH(int, count);
+   QFETCH(bool, compact);
+   QFETCH(bool, tree);
+
+   const QByteArray raw = records(count);
+   QJsonModel model;
+   QVERIFY(model.loadFromRaw(raw));
+   const auto document = QJsonDocument::fromJson(raw);
+
+   QByteArray output;
+   if (tree) {
+      QBENCHMARK {
+         output = model.json(compact);
+      }
+   }
+   else {
+      QBENCHMARK {
+         output = document.toJson(compact ? QJsonDocument::Compact : QJsonDocument::Indented);
+      }
+   }
+   QVERIFY(!output.isEmpty());
+}
+
+void QJsonModelBench::escape_data()
+{
+   QTest::addColumn<QString>("text");
+
+   const QString ascii = "The quick brown fox jumps over the lazy dog, 0123456789 times. ";
+   QTest::newRow("ascii") << ascii.repeated(4);
+   QTest::newRow("mixed") << QString::fromUtf8("Gr\xc3\xbc\xc3\x9f Gott, \xe6\x97\xa5\xe6\x9c\xac "
+                                                "\xf0\x9f\x98\x80 caf\xc3\xa9 ").repeated(8) + ascii;
+   QTest::newRow("escape heavy") << QString("C:\\path\\to\\\"file\"\n\ttab\r\n").repeated(12);
+}
+
+void QJsonModelBench::escape()
+{
+   QFETCH(QString, text);
+
+   QJsonArray strings;
+   for (int i = 0; i < 20000; ++i) {
+      strings.append(text);
+   }
+   QJsonModel model;
+   QVERIFY(model.loadFromValue(strings));
+
+   QByteArray output;
+   QBENCHMARK {
+      output = model.json(true);
+   }
+   QVERIFY(output.size() > 20000 * text.size());
+}
+
+void QJsonModelBench::numbers_data()
+{
+   QTest::addColumn<bool>("integral");
+
+   QTest::newRow("sensor readings") << false;
+   QTest::newRow("integers") << true;
+}
+
+void QJsonModelBench::numbers()
+{
+   QFETCH(bool, integral);
+
+   QJsonArray values;
+   for (int i = 0; i < 1000000; ++i) {
+      values.append(integral ? double(i * 37) : std::sin(i * 0.001) * 1000.0 + i * 1e-7);
+   }
+   QJsonModel model;
+   QVERIFY(model.loadFromValue(values));
+
+   QByteArray output;
+   QBENCHMARK {
+      output = model.json(true);
+   }
+   QVERIFY(!output.isEmpty());
+}
+
+void QJsonModelBench::ids_data()
+{
+   QTest::addColumn<bool>("load");
+
+   QTest::newRow("load") << true;
+   QTest::newRow("json") << false;
+}
+
+void QJsonModelBench::ids()
+{
+   QFETCH(bool, load);
+
+   // 64-bit ids past 2^53, which a double cannot hold
+   QByteArray json = "[";
+   for (int i = 0; i < 1000000; ++i) {
+      json += (i ? ",{\"id\":" : "{\"id\":") + QByteArray::number(Q_INT64_C(1234567890123456789) + i * Q_INT64_C(7919)) + "}";
+   }
+   json += "]";
+
+   QJsonModel model;
+   if (load) {
+      QBENCHMARK {
+         QVERIFY(model.loadFromRaw(json));
+      }
+      return;
+   }
+
+   QVERIFY(model.loadFromRaw(json));
+   QByteArray output;
+   QBENCHMARK {
+      output = model.json(true);
+   }
+   QCOMPARE(output, json);
+}
+
+void QJsonModelBench::objectKeys_data()
+{
+   QTest::addColumn<int>("count");
+
+   QTest::newRow("1k") << 1000;
+   QTest::newRow("10k") << 10000;
+   QTest::newRow("100k") << 100000;
+   QTest::newRow("1M") << 1000000;
+}
+
+void QJsonModelBench::objectKeys()
+{
+   QFETCH(int, count);
+
+   // loaded from a document and kept unfetched, so the object is written
+   // from its QJsonObject; unfetched items loaded from text copy the text
+   QJsonModel model;
+   model.setLazyLoading(true);
+   QVERIFY(model.loadFromDocument(QJsonDocument::fromJson(wideObject(count))));
+
+   QByteArray output;
+   QBENCHMARK {
+      output = model.json(true);
+   }
+   QVERIFY(!output.isEmpty());
+}
+
+void QJsonModelBench::load_data()
+{
+   QTest::addColumn<int>("count");
+   QTest::addColumn<bool>("document");
+
+   for (int count : {10000, 100000}) {
+      QTest::newRow((QByteArray::number(count) + " parser").constData()) << count << false;
+      QTest::newRow((QByteArray::number(count) + " document").constData()) << count << true;
+   }
+}
+
+void QJsonModelBench::load()
+{
+   QFETCH(int, count);
+   QFETCH(bool, document);
+
+   const QByteArray raw = records(count);
+   QJsonModel model;
+
+   if (document) {
+      QBENCHMARK {
+         model.loadFromDocument(QJsonDocument::fromJson(raw));
+      }
+   }
+   else {
+      QBENCHMARK {
+         model.loadFromRaw(raw);
+      }
+   }
+   QCOMPARE(model.rowCount(), count);
+}
+
+void QJsonModelBench::loadMemory_data()
+{
+   load_data();
+}
+
+void QJsonModelBench::loadMemory()
+{
+   QFETCH(int, count);
+   QFETCH(bool, document);
+
+   if (heapInUse() < 0) {
+      QSKIP("heap statistics are not available on this platform");
+   }
+
+   const QByteArray raw = records(count);
+   QJsonModel model;
+   const qint64 before = heapInUse();
+#ifdef HAVE_MALLINFO2
+   // freed pages go back to the system, so reusing them shows in the peak
+   malloc_trim(0);
+#endif
+   const bool peakKnown = resetPeakMemory();
+   const qint64 resident = processMemory("VmRSS:");
+
+   if (document) {
+      // the document and the tree are both alive until loading returns
+      const auto doc = QJsonDocument::fromJson(raw);
+      model.loadFromDocument(doc);
+   }
+   else {
+      model.loadFromRaw(raw);
+   }
+
+   // the peak is resident memory, so it is only known where it can be reset
+   const qint64 retained = heapInUse() - before;
+   if (peakKnown && resident >= 0) {
+      qInfo("%s: peak %lld KiB, retained %lld KiB", QTest::currentDataTag(),
+            (processMemory("VmHWM:") - resident) / 1024, retained / 1024);
+   }
+   else {
+      qInfo("%s: retained %lld KiB", QTest::currentDataTag(), retained / 1024);
+   }
+}
+
+void QJsonModelBench::arrayMemory()
+{
+   if (heapInUse() < 0) {
+      QSKIP("heap statistics are not available on this platform");
+   }
+
+   // a flat array of numbers, where the size of a scalar item is all there is
+   const int count = 1000000;
+   QByteArray raw = "[";
+   for (int i = 0; i < count; ++i) {
+      raw += (i ? "," : "") + QByteArray::number(i);
+   }
+   raw += "]";
+
+   QJsonModel model;
+   const qint64 before = heapInUse();
+   QVERIFY(model.loadFromRaw(raw));
+   const qint64 retained = heapInUse() - before;
+   qInfo("%lld bytes per element, items of %d bytes", retained / count, int(sizeof(QJsonTreeItem)));
+}
+
+void QJsonModelBench::loadClear_data()
+{
+   QTest::addColumn<int>("count");
+   QTest::addColumn<bool>("arena");
+
+   for (int count : {10000, 100000}) {
+      QTest::newRow((QByteArray::number(count) + " arena").constData()) << count << true;
+      QTest::newRow((QByteArray::number(count) + " heap").constData()) << count << false;
+   }
+}
+
+void QJsonModelBench::loadClear()
+{
+   QFETCH(int, count);
+   QFETCH(bool, arena);
+
+   const QJsonValue value = QJsonDocument::fromJson(records(count)).array();
+
+   if (arena) {
+      QJsonTreeArena treeArena;
+      QBENCHMARK {
+         QJsonTreeItem::load(value, nullptr, &treeArena);
+         treeArena.clear();
+      }
+   }
+   else {
+      QBENCHMARK {
+         delete QJsonTreeItem::load(value);
+      }
+   }
+}
+
+void QJsonModelBench::snapshot_data()
+{
+   QTest::addColumn<QString>("loader");
+
+   QTest::newRow("loadFromFile") << "json";
+   QTest::newRow("loadFromFile lazy") << "lazy";
+   QTest::newRow("loadSnapshot") << "snapshot";
+}
+
+void QJsonModelBench::snapshot()
+{
+   QFETCH(QString, loader);
+
+   // about 100 MB of JSON and its snapshot, written once for all rows
+   static QTemporaryDir dir;
+   QVERIFY(dir.isValid());
+   const QString jsonFile = dir.filePath("records.json");
+   const QString snapshotFile = dir.filePath("records.qjsn");
+   if (!QFile::exists(snapshotFile)) {
+      QFile file(jsonFile);
+      QVERIFY(file.open(QIODevice::WriteOnly));
+      file.write(records(1000000));
+      file.close();
+
+      QJsonModel model;
+      QVERIFY(model.loadFromFile(jsonFile));
+      QFile cache(snapshotFile);
+      QVERIFY(cache.open(QIODevice::WriteOnly));
+      QVERIFY(model.saveSnapshot(&cache));
+   }
+
+   // a cold start: open the document and show its first rows
+   QBENCHMARK {
+      QJsonModel model;
+      model.setLazyLoading(loader == "lazy");
+      QVERIFY(loader == "snapshot" ? model.loadSnapshot(snapshotFile) : model.loadFromFile(jsonFile));
+      if (model.canFetchMore(QModelIndex())) {
+         model.fetchMore(QModelIndex());
+      }
+      QVERIFY(model.rowCount() > 0);
+   }
+}
+
+void QJsonModelBench::binaryFormats_data()
+{
+   QTest::addColumn<QString>("format");
+
+   QTest::newRow("loadFromRaw") << "json";
+   QTest::newRow("loadFromCbor") << "cbor";
+   QTest::newRow("loadFromMsgPack") << "msgpack";
+}
+
+void QJsonModelBench::binaryFormats()
+{
+   QFETCH(QString, format);
+
+   // about 10 MB of JSON, encoded once for all rows
+   static const QByteArray raw = records(100000);
+   static QByteArray cbor;
+   static QByteArray msgpack;
+   if (cbor.isEmpty()) {
+      QJsonModel model;
+      QVERIFY(model.loadFromRaw(raw));
+      cbor = model.toCbor();
+      msgpack = model.toMsgPack();
+   }
+
+   QJsonModel model;
+   QBENCHMARK {
+      if (format == "cbor") {
+         QVERIFY(model.loadFromCbor(cbor));
+      }
+      else if (format == "msgpack") {
+         QVERIFY(model.loadFromMsgPack(msgpack));
+      }
+      else {
+         QVERIFY(model.loadFromRaw(raw));
+      }
+   }
+   QVERIFY(model.rowCount() > 0);
+}
+
+void QJsonModelBench::parallelLoad_data()
+{
+   QTest::addColumn<int>("threads");
+
+   QVector<int> counts = {1, 2, 4};
+   for (int threads = 8; threads <= QThread::idealThreadCount(); threads *= 2) {
+      counts.append(threads);
+   }
+   if (!counts.contains(QThread::idealThreadCount())) {
+      counts.append(QThread::idealThreadCount());
+   }
+   for (int threads : counts) {
+      QTest::newRow((QByteArray::number(threads) + " threads").constData()) << threads;
+   }
+}
+
+void QJsonModelBench::parallelLoad()
+{
+   QFETCH(int, threads);
+
+   // about 300 MB, generated once for all rows
+   static const QByteArray raw = records(3000000);
+
+   QJsonModel model;
+   model.setBuildThreads(threads);
+   model.setParallelThreshold(0);
+
+   QBENCHMARK_ONCE {
+      QVERIFY(model.loadFromRaw(raw));
+   }
+   QCOMPARE(model.rowCount(), 3000000);
+}
+
+void QJsonModelBench::pointer_data()
+{
+   QTest::addColumn<int>("count");
+   QTest::addColumn<bool>("indexed");
+
+   for (int count : {1000, 100000}) {
+      QTest::newRow((QByteArray::number(count) + " indexed").constData()) << count << true;
+      QTest::newRow((QByteArray::number(count) + " linear").constData()) << count << false;
+   }
+}
+
+void QJsonModelBench::pointer()
+{
+   QFETCH(int, count);
+   QFETCH(bool, indexed);
+
+   QJsonModel model;
+   model.setKeyIndexThreshold(indexed ? 64 : std::numeric_limits<int>::max());
+   QVERIFY(model.loadFromRaw(wideObject(count)));
+
+   QStringList pointers;
+   for (int i = 0; i < 1000; ++i) {
+      pointers.append("/0/key" + QString::number((i * 7919) % count));
+   }
+
+   QBENCHMARK {
+      for (const auto& pointer : pointers) {
+         model.indexFromPointer(pointer);
+      }
+   }
+}
+
+void QJsonModelBench::search_data()
+{
+   QTest::addColumn<int>("count");
+   QTest::addColumn<bool>("indexed");
+
+   for (int count : {10000, 100000}) {
+      QTest::newRow((QByteArray::number(count) + " indexed").constData()) << count << true;
+      QTest::newRow((QByteArray::number(count) + " scan").constData()) << count << false;
+   }
+}
+
+void QJsonModelBench::search()
+{
+   QFETCH(int, count);
+   QFETCH(bool, indexed);
+
+   QJsonModel model;
+   model.setSearchIndexEnabled(indexed);
+   QVERIFY(model.loadFromRaw(records(count)));
+   // built outside of the measured loop
+   model.findValues("record 1");
+
+   QModelIndexList hits;
+   QBENCHMARK {
+      hits = model.findValues("record 4242");
+   }
+   QVERIFY(!hits.isEmpty());
+}
+
+void QJsonModelBench::filter_data()
+{
+   QTest::addColumn<int>("count");
+   QTest::addColumn<bool>("json");
+
+   for (int count : {10000, 100000}) {
+      QTest::newRow((QByteArray::number(count) + " json proxy").constData()) << count << true;
+      QTest::newRow((QByteArray::number(count) + " sort filter proxy").constData()) << count << false;
+   }
+}
+
+void QJsonModelBench::filter()
+{
+   QFETCH(int, count);
+   QFETCH(bool, json);
+
+   QJsonModel model;
+   QVERIFY(model.loadFromRaw(records(count)));
+
+   if (json) {
+      QJsonFilterProxyModel proxy;
+      proxy.setSourceModel(&model);
+      QBENCHMARK {
+         proxy.setFilterValue("record 4242", Qt::MatchExactly);
+         proxy.setFilterValue("record 4243", Qt::MatchExactly);
+      }
+      QCOMPARE(proxy.rowCount(), 1);
+   }
+   else {
+      QSortFilterProxyModel proxy;
+      proxy.setRecursiveFilteringEnabled(true);
+      proxy.setFilterKeyColumn(1);
+      proxy.setSourceModel(&model);
+      QBENCHMARK {
+         proxy.setFilterFixedString("record 4242");
+         proxy.setFilterFixedString("record 4243");
+      }
+      QVERIFY(proxy.rowCount() > 0);
+   }
+}
+
+void QJsonModelBench::query_data()
+{
+   QTest::addColumn<QString>("expression");
+   QTest::addColumn<int>("hits");
+
+   QTest::newRow("filter") << "$[?(@.name == 'record 42')].id" << -1;
+   QTest::newRow("filter first hit") << "$[?(@.name == 'record 42')].id" << 1;
+   QTest::newRow("descendants") << "$..tags[1]" << -1;
+   QTest::newRow("index") << "$[90000].value" << -1;
+}
+
+void QJsonModelBench::query()
+{
+   QFETCH(QString, expression);
+   QFETCH(int, hits);
+
+   QJsonModel model;
+   QVERIFY(model.loadFromRaw(records(100000)));
+
+   // compiled once, run many times
+   const QJsonPath path(expression);
+   QModelIndexList result;
+   QBENCHMARK {
+      result = model.query(path, hits);
+   }
+   QVERIFY(!result.isEmpty());
+}
+
+
+QTEST_APPLESS_MAIN(QJsonModelBench)
+
+#include "tst_qjsonmodelbench.moc"
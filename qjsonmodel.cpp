@@ -25,453 +25,6519 @@
 
 #include "qjsonmodel.h"
 
+#include <QCborStreamReader>
+#include <QCborStreamWriter>
+#include <QCborValue>
 #include <QDebug>
 #include <QFile>
+#include <QFutureWatcher>
 #include <QJsonDocument>
+#include <QMutex>
+#include <QRegularExpression>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QSet>
+#include <QThread>
+#include <QThreadPool>
+#include <QTimer>
+#include <QVector>
+#include <QtAlgorithms>
+#include <QtEndian>
+#include <QtConcurrent/QtConcurrentRun>
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <type_traits>
 
-QJsonTreeItem::QJsonTreeItem(QJsonTreeItem* parent)
-   : mParent(parent)
-{
-}
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define QJSONMODEL_SSE2
+#endif
 
-QJsonTreeItem::~QJsonTreeItem()
-{
-   qDeleteAll(mChilds);
-}
+static const int SaveChunkSize = 64 * 1024;
+static const int MaxNestingDepth = 1024;
+static const int ProgressInterval = 256 * 1024;
+static const int MaxSplitDepth = 4;
+static const int SearchBatchSize = 20000;
+static const qint64 MaxSafeInteger = Q_INT64_C(9007199254740992);
+static const char SnapshotMagic[] = "QJSN";
+static const quint32 SnapshotVersion = 1;
+static const int SnapshotHeaderSize = 8;
+static const int SnapshotSlotSize = 16;
+static const int SnapshotTrailerSize = SnapshotSlotSize + 16;
+static const quint32 SnapshotNoKey = 0xffffffff;
 
-void QJsonTreeItem::appendChild(QJsonTreeItem* item)
-{
-   mChilds.append(item);
-}
+void doubleToJson(double d, QByteArray &json);
+static int grisu2(double value, char *digits, int *exponent);
+static void integerToJson(quint64 magnitude, bool negative, QByteArray &json);
 
-QJsonTreeItem* QJsonTreeItem::child(int row)
-{
-   return mChilds.value(row);
-}
+//=========================================================================
 
-QJsonTreeItem* QJsonTreeItem::parent()
+/// State shared by QJsonModel and the worker thread of an asynchronous load.
+/// The worker builds into the task's own arena; the model adopts the tree
+/// only if the task is still its current load once the worker is done.
+struct QJsonLoadTask
 {
-   return mParent;
-}
+   QJsonLoadTask()
+      : model(nullptr)
+      , thread(nullptr)
+      , total(0)
+      , parallelThreshold(0)
+      , threads(1)
+      , lazy(false)
+      , arena(new QJsonTreeArena)
+      , root(nullptr)
+      , file(nullptr)
+   {
+   }
 
-int QJsonTreeItem::childCount() const
-{
-   return mChilds.count();
-}
+   ~QJsonLoadTask()
+   {
+      delete arena;
+      delete file;
+   }
 
-int QJsonTreeItem::row() const
-{
-   if (mParent){
-      return mParent->mChilds.indexOf(const_cast<QJsonTreeItem*>(this));
+   /// Posts loadProgress() to the model; false once the load is canceled.
+   bool report(qint64 bytes)
+   {
+      if (canceled.loadAcquire()) {
+         return false;
+      }
+      QMutexLocker locker(&mutex);
+      if (model) {
+         QMetaObject::invokeMethod(model, "loadProgress", Qt::QueuedConnection,
+                                   Q_ARG(qint64, bytes), Q_ARG(qint64, total));
+      }
+      return true;
    }
 
-   return 0;
-}
+   void cancel()
+   {
+      canceled.storeRelease(1);
+      QMutexLocker locker(&mutex);
+      model = nullptr;
+   }
 
-void QJsonTreeItem::setKey(const QString& key)
-{
-   mKey = key;
-}
+   QAtomicInt canceled;
+   QMutex mutex;
+   QJsonModel* model;
+   QThread* thread;
+   QString fileName;
+   QByteArray source;
+   qint64 total;
+   qint64 parallelThreshold;
+   int threads;
+   bool lazy;
+   QJsonTreeArena* arena;
+   QJsonTreeItem* root;
+   QFile* file;
+};
 
-void QJsonTreeItem::setValue(const QVariant& value)
-{
-   mValue = value;
-}
+//=========================================================================
 
-void QJsonTreeItem::setType(const QJsonValue::Type& type)
+/// Returns where [begin, end) stops being well-formed UTF-8, or \a end: no
+/// overlong forms, surrogates or code points past U+10FFFF, which is text
+/// QString::fromUtf8() decodes without replacing anything.
+static const char* findInvalidUtf8(const char* begin, const char* end)
 {
-   mType = type;
-}
+   auto p = reinterpret_cast<const uchar*>(begin);
+   const auto e = reinterpret_cast<const uchar*>(end);
+   while (p < e) {
+      // skip ASCII eight bytes at a time
+      while (e - p >= 8) {
+         quint64 word;
+         std::memcpy(&word, p, 8);
+         if (word & Q_UINT64_C(0x8080808080808080)) {
+            break;
+         }
+         p += 8;
+      }
+      if (p == e) {
+         break;
+      }
+      if (*p < 0x80) {
+         ++p;
+         continue;
+      }
 
-QString QJsonTreeItem::key() const
-{
-   return mKey;
+      int extra = 0;
+      uint code = 0;
+      uint min = 0;
+      if ((*p & 0xe0) == 0xc0) {
+         extra = 1;
+         code = *p & 0x1f;
+         min = 0x80;
+      }
+      else if ((*p & 0xf0) == 0xe0) {
+         extra = 2;
+         code = *p & 0x0f;
+         min = 0x800;
+      }
+      else if ((*p & 0xf8) == 0xf0) {
+         extra = 3;
+         code = *p & 0x07;
+         min = 0x10000;
+      }
+      else {
+         return reinterpret_cast<const char*>(p);
+      }
+      if (e - p <= extra) {
+         return reinterpret_cast<const char*>(p);
+      }
+      for (int i = 1; i <= extra; ++i) {
+         if ((p[i] & 0xc0) != 0x80) {
+            return reinterpret_cast<const char*>(p);
+         }
+         code = (code << 6) | (p[i] & 0x3f);
+      }
+      if (code < min || code > 0x10ffff || (code >= 0xd800 && code <= 0xdfff)) {
+         return reinterpret_cast<const char*>(p);
+      }
+      p += extra + 1;
+   }
+   return end;
 }
 
-QVariant QJsonTreeItem::value() const
+static bool isValidUtf8(const char* begin, const char* end)
 {
-   return mValue;
+   return findInvalidUtf8(begin, end) == end;
 }
 
-QJsonValue::Type QJsonTreeItem::type() const
+/// Decodes UTF-8 text, keeping a leading U+FEFF that QString::fromUtf8()
+/// would take for a byte order mark and drop.
+static QString utf8ToString(const char* begin, const char* end)
 {
-   return mType;
+   QString text;
+   while (end - begin >= 3 && qstrncmp(begin, "\xef\xbb\xbf", 3) == 0) {
+      text += QChar(0xfeff);
+      begin += 3;
+   }
+   return text + QString::fromUtf8(begin, int(end - begin));
 }
 
-QJsonTreeItem* QJsonTreeItem::load(const QJsonValue& value, QJsonTreeItem* parent)
+/// Reads UTF-8 JSON text in place. Builds QJsonTreeItem nodes straight from
+/// the bytes, validates text without building anything, and walks the byte
+/// range a lazy item was loaded from. Errors keep the offset they occurred at.
+class QJsonReader
 {
-   auto rootItem = new QJsonTreeItem(parent);
-   rootItem->setKey("root");
+public:
+   QJsonReader(const char* begin, const char* end)
+      : mBegin(begin)
+      , mPos(begin)
+      , mEnd(end)
+      , mError(QJsonParseError::NoError)
+      , mErrorPos(begin)
+      , mArena(nullptr)
+      , mTask(nullptr)
+      , mNextPoll(begin)
+      , mCanceled(false)
+   {
+   }
 
-   if (value.isObject())
+   /// Items created by parseItem() are allocated from \a arena.
+   void setArena(QJsonTreeArena* arena) { mArena = arena; }
+
+   /// Reports the progress of reading to \a task, and stops once it is canceled.
+   void setTask(QJsonLoadTask* task) { mTask = task; }
+   bool canceled() const { return mCanceled; }
+
+   const char* pos() const { return mPos; }
+   bool atEnd() const { return mPos >= mEnd; }
+   char peek() const { return mPos < mEnd ? *mPos : '\0'; }
+   void advance() { ++mPos; }
+
+   QJsonParseError::ParseError error() const { return mError; }
+   int errorOffset() const { return int(mErrorPos - mBegin); }
+
+   void skipWhitespace()
    {
-      auto object = value.toObject();
-      for(auto it=object.begin(); it!=object.end(); ++it){
-         auto value = it.value();
-         QJsonTreeItem* child = load(value, rootItem);
-         child->setKey(it.key());
-         child->setType(value.type());
-         rootItem->appendChild(child);
+      while (mPos < mEnd && (*mPos == ' ' || *mPos == '\n' || *mPos == '\r' || *mPos == '\t')) {
+         ++mPos;
       }
    }
 
-   else if (value.isArray())
+   bool consume(char c)
    {
-      int index = 0;
-      for (auto&& v : value.toArray())
-      {
-         QJsonTreeItem* child = load(v, rootItem);
-         child->setKey(QString::number(index));
-         child->setType(v.type());
-         rootItem->appendChild(child);
-         ++index;
+      if (peek() != c) {
+         return false;
       }
+      ++mPos;
+      return true;
    }
-   else
+
+   bool parseString(QString* out, bool* escaped = nullptr);
+   bool parseNumber(double* out, bool* integral = nullptr);
+   bool parseScalar(QVariant* value, QJsonValue::Type* type);
+   bool parseScalarItem(QJsonTreeItem* item);
+   bool parseItem(QJsonTreeItem* item, int depth = 0);
+   bool skipValue(int depth = 0);
+
+   bool fail(QJsonParseError::ParseError error)
    {
-      rootItem->setValue(value.toVariant());
-      rootItem->setType(value.type());
+      if (mError == QJsonParseError::NoError) {
+         mError = error;
+         mErrorPos = mPos;
+      }
+      return false;
    }
 
-   return rootItem;
-}
-
-//=========================================================================
+   /// Fails at the first byte of [run, mPos) that is not well-formed UTF-8.
+   bool checkUtf8(const char* run)
+   {
+      const char* invalid = findInvalidUtf8(run, mPos);
+      if (invalid != mPos) {
+         mPos = invalid;
+         return fail(QJsonParseError::IllegalUTF8String);
+      }
+      return true;
+   }
 
-inline uchar hexdig(uint u)
-{
-    return (u < 0xa ? '0' + u : 'a' + u - 0xa);
-}
+private:
+   bool parseLiteral(const char* literal, int length);
+   bool parseNumberItem(QJsonTreeItem* item);
 
-QByteArray escapedString(const QString &s)
-{
-    QByteArray ba(s.length(), Qt::Uninitialized);
-    uchar *cursor = reinterpret_cast<uchar *>(const_cast<char *>(ba.constData()));
-    const uchar *ba_end = cursor + ba.length();
-    const ushort *src = reinterpret_cast<const ushort *>(s.constBegin());
-    const ushort *const end = reinterpret_cast<const ushort *>(s.constEnd());
-    while (src != end)
-    {
-        if (cursor >= ba_end - 6)
-        {
-            // ensure we have enough space
-            int pos = cursor - (const uchar *)ba.constData();
-            ba.resize(ba.size() * 2);
-            cursor = (uchar *)ba.data() + pos;
-            ba_end = (const uchar *)ba.constData() + ba.length();
-        }
-        uint u = *src++;
-        if (u < 0x80)
-        {
-            if (u < 0x20 || u == 0x22 || u == 0x5c)
-            {
-                *cursor++ = '\\';
-                switch (u)
-                {
-                case 0x22:
-                    *cursor++ = '"';
-                    break;
-                case 0x5c:
-                    *cursor++ = '\\';
-                    break;
-                case 0x8:
-                    *cursor++ = 'b';
-                    break;
-                case 0xc:
-                    *cursor++ = 'f';
-                    break;
-                case 0xa:
-                    *cursor++ = 'n';
-                    break;
-                case 0xd:
-                    *cursor++ = 'r';
-                    break;
-                case 0x9:
-                    *cursor++ = 't';
-                    break;
-                default:
-                    *cursor++ = 'u';
-                    *cursor++ = '0';
-                    *cursor++ = '0';
-                    *cursor++ = hexdig(u >> 4);
-                    *cursor++ = hexdig(u & 0xf);
-                }
-            }
-            else
-            {
-                *cursor++ = (uchar)u;
-            }
-        }
-        else if (QUtf8Functions::toUtf8<QUtf8BaseTraits>(u, cursor, src, end) < 0)
-        {
-            // failed to get valid utf8 use JSON escape sequence
-            *cursor++ = '\\';
-            *cursor++ = 'u';
-            *cursor++ = hexdig(u >> 12 & 0x0f);
-            *cursor++ = hexdig(u >> 8 & 0x0f);
-            *cursor++ = hexdig(u >> 4 & 0x0f);
-            *cursor++ = hexdig(u & 0x0f);
-        }
-    }
-    ba.resize(cursor - (const uchar *)ba.constData());
-    return ba;
-}
+   bool poll()
+   {
+      if (!mTask || mPos < mNextPoll) {
+         return true;
+      }
+      if (!mTask->report(mPos - mBegin)) {
+         mCanceled = true;
+         return false;
+      }
+      mNextPoll = mPos + qMax<qint64>(ProgressInterval, (mEnd - mBegin) / 100);
+      return true;
+   }
 
-QJsonModel::QJsonModel(QObject *parent)
-    : QAbstractItemModel(parent)
-    , mRootItem{new QJsonTreeItem}
-    , mMode{Mode::ReadOnly}
-{
-}
+   const char* mBegin;
+   const char* mPos;
+   const char* mEnd;
+   QJsonParseError::ParseError mError;
+   const char* mErrorPos;
+   QJsonTreeArena* mArena;
+   QJsonKeyPool mKeys;
+   QJsonLoadTask* mTask;
+   const char* mNextPoll;
+   bool mCanceled;
+};
 
-QJsonModel::QJsonModel(const QString& fileName, QObject* parent)
-   : QJsonModel(parent)
+/// Sorts object members by key and moves all but the last of several equal
+/// keys behind the returned count, which is what QJsonObject keeps.
+template <typename T, typename KeyOf>
+static int sortMembers(QVector<T>& members, KeyOf keyOf)
 {
-   loadFromFile(fileName);
-}
+   std::stable_sort(members.begin(), members.end(), [&](const T& a, const T& b) {
+      return keyOf(a) < keyOf(b);
+   });
 
-QJsonModel::QJsonModel(QIODevice* device, QObject* parent)
-   : QJsonModel(parent)
-{
-   if (device) {
-      loadFromDevice(device);
+   int count = 0;
+   for (int i = 0; i < members.size(); ++i) {
+      if (i + 1 < members.size() && keyOf(members.at(i + 1)) == keyOf(members.at(i))) {
+         continue;
+      }
+      std::swap(members[count++], members[i]);
    }
+   return count;
 }
 
-QJsonModel::QJsonModel(const QByteArray& json, QObject* parent)
-   : QJsonModel(parent)
+/// Appends the members of an object to \a object sorted by key, dropping all
+/// but the last of equal keys.
+static void appendMembers(QJsonTreeItem* object, QVector<QJsonTreeItem*>& members, QJsonTreeArena* arena)
 {
-   loadFromRaw(json);
+   const int count = sortMembers(members, [](QJsonTreeItem* member) { return member->key(); });
+   for (int i = 0; i < members.size(); ++i) {
+      if (i < count) {
+         object->appendChild(members.at(i));
+      }
+      else {
+         QJsonTreeItem::destroy(members.at(i), arena);
+      }
+   }
 }
 
-QJsonModel::~QJsonModel()
+static inline bool isDigit(char c)
 {
-   delete mRootItem;
+   return c >= '0' && c <= '9';
 }
 
-bool QJsonModel::loadFromFile(const QString& fileName)
+/// A JSON number seen as 0.d1d2... times 10^point, where the significant
+/// digits run from first to last, skipping any decimal point.
+struct QJsonDecimal
 {
-   QFile file(fileName);
-   bool success = false;
+   QJsonDecimal(const char* begin, const char* end)
+      : negative(begin < end && *begin == '-')
+      , first(nullptr)
+      , last(nullptr)
+      , point(0)
+   {
+      const char* p = begin + (negative ? 1 : 0);
+      int integerDigits = -1;
+      int count = 0;
+      int zeros = 0;
+      for (; p < end && *p != 'e' && *p != 'E'; ++p) {
+         if (*p == '.') {
+            integerDigits = count;
+            continue;
+         }
+         if (!first && *p == '0') {
+            ++zeros;
+         }
+         else {
+            first = first ? first : p;
+            last = *p != '0' ? p + 1 : last;
+         }
+         ++count;
+      }
+      if (integerDigits < 0) {
+         integerDigits = count;
+      }
 
-   if (file.open(QIODevice::ReadOnly)) {
-      success = loadFromDevice(&file);
-      file.close();
+      // clamped far past the double range, safe from overflow
+      int exponent = 0;
+      if (p < end) {
+         ++p;
+         const bool negativeExponent = *p == '-';
+         if (*p == '-' || *p == '+') {
+            ++p;
+         }
+         for (; p < end; ++p) {
+            exponent = qMin(exponent * 10 + (*p - '0'), 100000);
+         }
+         exponent = negativeExponent ? -exponent : exponent;
+      }
+      if (first) {
+         point = integerDigits - zeros + exponent;
+      }
    }
 
-   return success;
-}
+   bool isZero() const { return !first; }
 
-bool QJsonModel::loadFromDevice(QIODevice* device)
-{
-   return loadFromRaw(device->readAll());
-}
+   bool negative;
+   const char* first;
+   const char* last;
+   int point;
+};
 
-bool QJsonModel::loadFromValue(const QJsonValue& value)
+/// The double nearest to the valid JSON number [begin, end), or the infinity
+/// or zero it rounds to when it is out of the double range.
+static double readDouble(const char* begin, const char* end)
 {
-   if(!value.isObject() && !value.isArray()) {
-      qDebug() << Q_FUNC_INFO << "value must be object or array";
-      return false;
+   const bool negative = *begin == '-';
+   const char* p = begin + (negative ? 1 : 0);
+   while (p < end && isDigit(*p)) {
+      ++p;
+   }
+   if (p == end && end - begin - negative <= 18) {
+      // exact in a qint64, and converting that to double rounds correctly
+      qint64 value = 0;
+      for (p = begin + negative; p < end; ++p) {
+         value = value * 10 + (*p - '0');
+      }
+      return negative ? -double(value) : double(value);
    }
 
-   beginResetModel();
-   delete mRootItem;
-   mRootItem = QJsonTreeItem::load(value);
-   mRootItem->setType(value.isObject() ? QJsonValue::Object : QJsonValue::Array);
-   endResetModel();
-
-   return true;
+   bool ok = false;
+   const double d = QByteArray(begin, int(end - begin)).toDouble(&ok);
+   if (ok) {
+      return d;
+   }
+   const double rounded = QJsonDecimal(begin, end).point > 0 ? std::numeric_limits<double>::infinity() : 0.0;
+   return negative ? -rounded : rounded;
 }
 
-bool QJsonModel::loadFromDocument(const QJsonDocument& document)
+/// Whether \a d, written back as JSON, is the same number as the text
+/// [begin, end) it was read from. Compares the digits doubleToJson() writes.
+static bool roundTrips(const char* begin, const char* end, double d)
 {
-   if(document.isNull()) {
-      qDebug() << Q_FUNC_INFO << "cannot load json";
+   const QJsonDecimal text(begin, end);
+   if (text.isZero() || d == 0) {
+      return text.isZero() && d == 0;
+   }
+   if (!qIsFinite(d)) {
       return false;
    }
 
-   beginResetModel();
-   delete mRootItem;
-   if (document.isArray()) {
-      mRootItem = QJsonTreeItem::load(QJsonValue(document.array()));
-      mRootItem->setType(QJsonValue::Array);
+   char digits[20];
+   int length = 0;
+   int exponent = 0;
+   const double magnitude = qAbs(d);
+   if (magnitude < 9007199254740992.0 && magnitude == double(qint64(magnitude))) {
+      for (quint64 n = quint64(magnitude); n != 0; n /= 10) {
+         digits[length++] = char('0' + n % 10);
+      }
+      std::reverse(digits, digits + length);
+   }
+   else {
+      length = grisu2(magnitude, digits, &exponent);
+   }
+   if (text.point != length + exponent) {
+      return false;
+   }
+   while (digits[length - 1] == '0') {
+      --length;
+   }
 
-   } else {
-      mRootItem = QJsonTreeItem::load(QJsonValue(document.object()));
-      mRootItem->setType(QJsonValue::Object);
+   int i = 0;
+   for (const char* p = text.first; p < text.last; ++p) {
+      if (*p != '.' && (i == length || *p != digits[i++])) {
+         return false;
+      }
    }
-   endResetModel();
-   return true;
+   return i == length;
 }
 
-bool QJsonModel::loadFromRaw(const QByteArray& json)
+static inline int hexValue(char c)
 {
-   return loadFromDocument(QJsonDocument::fromJson(json));
+   if (c >= '0' && c <= '9')
+      return c - '0';
+   if (c >= 'a' && c <= 'f')
+      return c - 'a' + 10;
+   if (c >= 'A' && c <= 'F')
+      return c - 'A' + 10;
+   return -1;
 }
 
-QVariant QJsonModel::data(const QModelIndex& index, int role) const
+bool QJsonReader::parseString(QString* out, bool* escaped)
 {
-   if (!index.isValid()){
-      return QVariant();
+   if (!consume('"')) {
+      return fail(QJsonParseError::IllegalValue);
    }
 
-   auto item = internalData(index);
+   const char* run = mPos;
+   bool hasEscapes = false;
+   QString result;
 
-   if (role == Qt::DisplayRole) {
-      if (index.column() == 0){
-         return item->key();
+   while (true) {
+      if (mPos >= mEnd) {
+         return fail(QJsonParseError::UnterminatedString);
       }
 
-      if (index.column() == 1) {
-         return item->value();
+      const uchar c = uchar(*mPos);
+      if (c == '"') {
+         break;
+      }
+      if (c < 0x20) {
+         return fail(QJsonParseError::IllegalValue);
+      }
+      if (c != '\\') {
+         ++mPos;
+         continue;
       }
 
-   } else if (Qt::EditRole == role) {
-      if (index.column() == 1) {
-         return item->value();
+      if (!checkUtf8(run)) {
+         return false;
+      }
+      if (out) {
+         result += utf8ToString(run, mPos);
+      }
+      hasEscapes = true;
+      ++mPos;
+      if (mPos >= mEnd) {
+         return fail(QJsonParseError::UnterminatedString);
       }
-   }
 
-   return QVariant();
-}
+      ushort u = 0;
+      switch (*mPos) {
+      case '"': u = '"'; break;
+      case '\\': u = '\\'; break;
+      case '/': u = '/'; break;
+      case 'b': u = 0x8; break;
+      case 'f': u = 0xc; break;
+      case 'n': u = 0xa; break;
+      case 'r': u = 0xd; break;
+      case 't': u = 0x9; break;
+      case 'u':
+         if (mEnd - mPos < 5) {
+            return fail(QJsonParseError::IllegalEscapeSequence);
+         }
+         for (int i = 1; i <= 4; ++i) {
+            const int digit = hexValue(mPos[i]);
+            if (digit < 0) {
+               return fail(QJsonParseError::IllegalEscapeSequence);
+            }
+            u = ushort((u << 4) | digit);
+         }
+         mPos += 4;
+         break;
+      default:
+         return fail(QJsonParseError::IllegalEscapeSequence);
+      }
+      ++mPos;
 
-bool QJsonModel::setData(const QModelIndex& index, const QVariant& value, int role)
-{
-   int col = index.column();
-   if (Qt::EditRole == role) {
-      if (col == 1) {
-         auto item = internalData(index);
-         item->setValue(value);
-         emit dataChanged(index, index, {Qt::EditRole});
-         return true;
+      if (out) {
+         result += QChar(u);
       }
+      run = mPos;
    }
 
-   return false;
-}
-
-QVariant QJsonModel::headerData(int section, Qt::Orientation orientation, int role) const
-{
-   if (role != Qt::DisplayRole){
-      return QVariant();
+   if (!checkUtf8(run)) {
+      return false;
    }
-
-   if (orientation == Qt::Horizontal) {
-      static const QStringList headers{{"key", "value"}};
-      return headers.value(section);
+   if (out) {
+      if (hasEscapes) {
+         result += utf8ToString(run, mPos);
+         *out = result;
+      }
+      else {
+         *out = utf8ToString(run, mPos);
+      }
    }
-   else {
-      return QVariant();
+   if (escaped) {
+      *escaped = hasEscapes;
    }
+   ++mPos;
+   return true;
 }
 
-QModelIndex QJsonModel::index(int row, int column, const QModelIndex& parent) const
+bool QJsonReader::parseNumber(double* out, bool* integral)
 {
-   if (!hasIndex(row, column, parent)) {
-      return QModelIndex();
+   const char* start = mPos;
+   consume('-');
+
+   if (!consume('0')) {
+      if (peek() < '1' || peek() > '9') {
+         return fail(QJsonParseError::IllegalNumber);
+      }
+      while (isDigit(peek())) {
+         ++mPos;
+      }
    }
 
-   QJsonTreeItem* parentItem = parent.isValid() ? internalData(parent) : mRootItem;
+   bool fraction = false;
+   if (consume('.')) {
+      fraction = true;
+      if (!isDigit(peek())) {
+         return fail(QJsonParseError::IllegalNumber);
+      }
+      while (isDigit(peek())) {
+         ++mPos;
+      }
+   }
+   if (peek() == 'e' || peek() == 'E') {
+      fraction = true;
+      ++mPos;
+      if (peek() == '+' || peek() == '-') {
+         ++mPos;
+      }
+      if (!isDigit(peek())) {
+         return fail(QJsonParseError::IllegalNumber);
+      }
+      while (isDigit(peek())) {
+         ++mPos;
+      }
+   }
 
-   if (auto childItem = parentItem->child(row)) {
-      return createIndex(row, column, childItem);
+   if (integral) {
+      *integral = !fraction;
    }
-   else {
-      return QModelIndex();
+   if (out) {
+      *out = readDouble(start, mPos);
    }
+   return true;
 }
 
-QModelIndex QJsonModel::parent(const QModelIndex& index) const
+/// Reads a number into \a item without losing any of it: integers that fit
+/// 64 bits stay integers, and numbers no double reads back exactly keep
+/// their text.
+bool QJsonReader::parseNumberItem(QJsonTreeItem* item)
+{
+   const char* start = mPos;
+   bool integral = false;
+   if (!parseNumber(nullptr, &integral)) {
+      return false;
+   }
+   const bool negative = *start == '-';
+
+   // -0 is a double, as the sign is all it has
+   if (integral && !(negative && mPos - start == 2 && start[1] == '0')) {
+      quint64 magnitude = 0;
+      bool fits = true;
+      for (const char* p = start + negative; fits && p < mPos; ++p) {
+         const uint digit = uint(*p - '0');
+         fits = magnitude <= (std::numeric_limits<quint64>::max() - digit) / 10;
+         magnitude = magnitude * 10 + digit;
+      }
+      const quint64 max = quint64(std::numeric_limits<qint64>::max());
+      if (fits && !negative && magnitude > max) {
+         item->setUnsigned(magnitude);
+         return true;
+      }
+      if (fits && magnitude <= max + (negative ? 1 : 0)) {
+         item->setInteger(negative ? -qint64(magnitude - 1) - 1 : qint64(magnitude));
+         return true;
+      }
+   }
+   else {
+      const double d = readDouble(start, mPos);
+      if (roundTrips(start, mPos, d)) {
+         item->setValue(d);
+         return true;
+      }
+   }
+   item->setUtf8Value(start, mPos, QJsonValue::Double);
+   return true;
+}
+
+bool QJsonReader::parseLiteral(const char* literal, int length)
+{
+   if (mEnd - mPos < length || qstrncmp(mPos, literal, uint(length)) != 0) {
+      return fail(QJsonParseError::IllegalValue);
+   }
+   mPos += length;
+   return true;
+}
+
+bool QJsonReader::parseScalar(QVariant* value, QJsonValue::Type* type)
+{
+   QJsonValue::Type parsed = QJsonValue::Undefined;
+
+   switch (peek()) {
+   case '"': {
+      QString string;
+      if (!parseString(value ? &string : nullptr)) {
+         return false;
+      }
+      if (value) {
+         *value = string;
+      }
+      parsed = QJsonValue::String;
+      break;
+   }
+   case 't':
+   case 'f': {
+      const bool b = peek() == 't';
+      if (!(b ? parseLiteral("true", 4) : parseLiteral("false", 5))) {
+         return false;
+      }
+      if (value) {
+         *value = b;
+      }
+      parsed = QJsonValue::Bool;
+      break;
+   }
+   case 'n':
+      if (!parseLiteral("null", 4)) {
+         return false;
+      }
+      if (value) {
+         *value = QJsonValue().toVariant();
+      }
+      parsed = QJsonValue::Null;
+      break;
+   default: {
+      if (peek() != '-' && !isDigit(peek())) {
+         return fail(QJsonParseError::IllegalValue);
+      }
+      double d = 0;
+      if (!parseNumber(value ? &d : nullptr)) {
+         return false;
+      }
+      if (value) {
+         *value = d;
+      }
+      parsed = QJsonValue::Double;
+   }
+   }
+
+   if (type) {
+      *type = parsed;
+   }
+   return true;
+}
+
+/// Reads a scalar into \a item. Strings that need no decoding keep their
+/// UTF-8 bytes: the writer copies them as they are and value() decodes them.
+bool QJsonReader::parseScalarItem(QJsonTreeItem* item)
+{
+   if (peek() == '-' || isDigit(peek())) {
+      return parseNumberItem(item);
+   }
+   if (peek() == '"') {
+      const char* begin = mPos + 1;
+      bool escaped = false;
+      if (!parseString(nullptr, &escaped)) {
+         return false;
+      }
+      if (!escaped) {
+         item->setUtf8Value(begin, mPos - 1);
+         return true;
+      }
+      mPos = begin - 1;
+   }
+
+   QVariant value;
+   QJsonValue::Type type = QJsonValue::Null;
+   if (!parseScalar(&value, &type)) {
+      return false;
+   }
+   item->setValue(value);
+   item->setType(type);
+   return true;
+}
+
+bool QJsonReader::parseItem(QJsonTreeItem* item, int depth)
+{
+   skipWhitespace();
+   if (!poll()) {
+      return false;
+   }
+   const char c = peek();
+   if (c != '{' && c != '[') {
+      return parseScalarItem(item);
+   }
+
+   if (depth >= MaxNestingDepth) {
+      return fail(QJsonParseError::DeepNesting);
+   }
+
+   const bool object = c == '{';
+   const char close = object ? '}' : ']';
+   item->setType(object ? QJsonValue::Object : QJsonValue::Array);
+   ++mPos;
+   skipWhitespace();
+   if (consume(close)) {
+      return true;
+   }
+
+   // array elements are appended as they are read, object members once
+   // they have been sorted
+   QVector<QJsonTreeItem*> members;
+   bool success = true;
+   while (true) {
+      auto child = QJsonTreeItem::create(item, mArena);
+      if (object) {
+         members.append(child);
+         skipWhitespace();
+         if (atEnd()) {
+            success = fail(QJsonParseError::UnterminatedObject);
+            break;
+         }
+         QString key;
+         if (!parseString(&key)) {
+            success = false;
+            break;
+         }
+         // without an arena, equal keys still share one string per parse
+         child->setKey((mArena ? mArena->keys() : mKeys).intern(key));
+         skipWhitespace();
+         if (!consume(':')) {
+            success = fail(QJsonParseError::MissingNameSeparator);
+            break;
+         }
+      }
+      else {
+         item->appendChild(child);
+      }
+
+      if (!parseItem(child, depth + 1)) {
+         success = false;
+         break;
+      }
+      skipWhitespace();
+      if (consume(',')) {
+         continue;
+      }
+      if (consume(close)) {
+         break;
+      }
+      success = fail(atEnd() ? (object ? QJsonParseError::UnterminatedObject : QJsonParseError::UnterminatedArray)
+                             : QJsonParseError::MissingValueSeparator);
+      break;
+   }
+
+   if (!success) {
+      for (auto member : members) {
+         QJsonTreeItem::destroy(member, mArena);
+      }
+      return false;
+   }
+
+   if (object) {
+      appendMembers(item, members, mArena);
+   }
+   return true;
+}
+
+bool QJsonReader::skipValue(int depth)
+{
+   skipWhitespace();
+   if (!poll()) {
+      return false;
+   }
+   const char c = peek();
+   if (c != '{' && c != '[') {
+      return parseScalar(nullptr, nullptr);
+   }
+
+   if (depth >= MaxNestingDepth) {
+      return fail(QJsonParseError::DeepNesting);
+   }
+
+   const bool object = c == '{';
+   const char close = object ? '}' : ']';
+   ++mPos;
+   skipWhitespace();
+   if (consume(close)) {
+      return true;
+   }
+
+   while (true) {
+      if (object) {
+         skipWhitespace();
+         if (atEnd()) {
+            return fail(QJsonParseError::UnterminatedObject);
+         }
+         if (!parseString(nullptr)) {
+            return false;
+         }
+         skipWhitespace();
+         if (!consume(':')) {
+            return fail(QJsonParseError::MissingNameSeparator);
+         }
+      }
+      if (!skipValue(depth + 1)) {
+         return false;
+      }
+      skipWhitespace();
+      if (consume(',')) {
+         continue;
+      }
+      if (consume(close)) {
+         return true;
+      }
+      if (atEnd()) {
+         return fail(object ? QJsonParseError::UnterminatedObject : QJsonParseError::UnterminatedArray);
+      }
+      return fail(QJsonParseError::MissingValueSeparator);
+   }
+}
+
+/// A direct child of an object or array, as a byte range of the raw text.
+struct QJsonRawMember
+{
+   QString key;
+   const char* begin;
+   const char* end;
+};
+
+/// Lists the direct children of the object or array in [begin, end). Object
+/// members are sorted by key and deduplicated like QJsonObject does. \a last
+/// receives the position after the closing bracket.
+static bool indexRaw(const char* begin, const char* end, QVector<QJsonRawMember>& members,
+                     const char** last = nullptr)
+{
+   QJsonReader reader(begin, end);
+   reader.skipWhitespace();
+   const bool object = reader.peek() == '{';
+   const char close = object ? '}' : ']';
+   reader.advance();
+   reader.skipWhitespace();
+   if (reader.consume(close)) {
+      if (last) {
+         *last = reader.pos();
+      }
+      return true;
+   }
+
+   while (true) {
+      QJsonRawMember member;
+      if (object) {
+         reader.skipWhitespace();
+         if (!reader.parseString(&member.key)) {
+            return false;
+         }
+         reader.skipWhitespace();
+         if (!reader.consume(':')) {
+            return false;
+         }
+      }
+      reader.skipWhitespace();
+      member.begin = reader.pos();
+      if (!reader.skipValue()) {
+         return false;
+      }
+      member.end = reader.pos();
+      members.append(member);
+
+      reader.skipWhitespace();
+      if (reader.consume(',')) {
+         continue;
+      }
+      if (!reader.consume(close)) {
+         return false;
+      }
+      break;
+   }
+
+   if (last) {
+      *last = reader.pos();
+   }
+   if (object) {
+      members.resize(sortMembers(members, [](const QJsonRawMember& member) { return member.key; }));
+   }
+
+   return true;
+}
+
+//=========================================================================
+
+/// Whether the UTF-8 string [begin, end) is written to JSON as it is: valid
+/// and with nothing to escape.
+static bool isVerbatimUtf8(const char* begin, const char* end)
+{
+   for (const char* p = begin; p < end; ++p) {
+      const uchar c = uchar(*p);
+      if (c < 0x20 || c == '"' || c == '\\') {
+         return false;
+      }
+   }
+   return isValidUtf8(begin, end);
+}
+
+/// JSON has no byte strings: they become base64url text, as in
+/// QCborValue::toJsonValue().
+static QString binaryToString(const QByteArray& data)
+{
+   return QString::fromLatin1(data.toBase64(QByteArray::Base64UrlEncoding | QByteArray::OmitTrailingEquals));
+}
+
+/// Builds QJsonTreeItem nodes straight from a CBOR stream, without a
+/// QCborValue in between. Tags are dropped, byte strings become base64url
+/// text and keys that are not text become their diagnostic notation.
+class QJsonCborReader
+{
+public:
+   QJsonCborReader(QCborStreamReader& reader, QJsonTreeArena* arena)
+      : mReader(reader)
+      , mArena(arena)
+   {
+   }
+
+   bool readItem(QJsonTreeItem* item, int depth = 0)
+   {
+      while (mReader.isTag()) {
+         mReader.next();
+      }
+
+      switch (mReader.type()) {
+      case QCborStreamReader::UnsignedInteger: {
+         const quint64 value = mReader.toUnsignedInteger();
+         if (value > quint64(std::numeric_limits<qint64>::max())) {
+            item->setUnsigned(value);
+         }
+         else {
+            item->setInteger(qint64(value));
+         }
+         return mReader.next();
+      }
+      case QCborStreamReader::NegativeInteger: {
+         // the magnitude, where 0 stands for 2^64
+         const quint64 magnitude = quint64(mReader.toNegativeInteger());
+         if (magnitude != 0 && magnitude <= quint64(std::numeric_limits<qint64>::max()) + 1) {
+            item->setInteger(-qint64(magnitude - 1) - 1);
+         }
+         else {
+            const QByteArray text = magnitude ? '-' + QByteArray::number(magnitude) : QByteArray("-18446744073709551616");
+            item->setUtf8Value(text.constData(), text.constData() + text.size(), QJsonValue::Double);
+         }
+         return mReader.next();
+      }
+      case QCborStreamReader::Float16:
+         item->setValue(double(float(mReader.toFloat16())));
+         return mReader.next();
+      case QCborStreamReader::Float:
+         item->setValue(double(mReader.toFloat()));
+         return mReader.next();
+      case QCborStreamReader::Double:
+         item->setValue(mReader.toDouble());
+         return mReader.next();
+      case QCborStreamReader::SimpleType:
+         if (mReader.isBool()) {
+            item->setValue(mReader.toBool());
+         }
+         return mReader.next();
+      case QCborStreamReader::TextString: {
+         QString text;
+         if (!readString(&text)) {
+            return false;
+         }
+         item->setValue(text);
+         return true;
+      }
+      case QCborStreamReader::ByteString: {
+         QByteArray data;
+         auto chunk = mReader.readByteArray();
+         while (chunk.status == QCborStreamReader::Ok) {
+            data += chunk.data;
+            chunk = mReader.readByteArray();
+         }
+         item->setValue(binaryToString(data));
+         return chunk.status != QCborStreamReader::Error;
+      }
+      case QCborStreamReader::Array:
+      case QCborStreamReader::Map:
+         return readContainer(item, depth);
+      default:
+         return false;
+      }
+   }
+
+private:
+   bool readContainer(QJsonTreeItem* item, int depth)
+   {
+      if (depth >= MaxNestingDepth) {
+         return false;
+      }
+      const bool object = mReader.isMap();
+      item->setType(object ? QJsonValue::Object : QJsonValue::Array);
+      if (!mReader.enterContainer()) {
+         return false;
+      }
+
+      QVector<QJsonTreeItem*> members;
+      bool success = true;
+      while (success && mReader.hasNext()) {
+         auto child = QJsonTreeItem::create(item, mArena);
+         if (object) {
+            members.append(child);
+            QString key;
+            success = readKey(&key);
+            child->setKey(mArena->keys().intern(key));
+         }
+         else {
+            item->appendChild(child);
+         }
+         success = success && readItem(child, depth + 1);
+      }
+
+      if (!success || mReader.lastError() != QCborError::NoError) {
+         for (auto member : members) {
+            QJsonTreeItem::destroy(member, mArena);
+         }
+         return false;
+      }
+      appendMembers(item, members, mArena);
+      return mReader.leaveContainer();
+   }
+
+   bool readKey(QString* key)
+   {
+      if (mReader.isString()) {
+         return readString(key);
+      }
+      if (mReader.isUnsignedInteger()) {
+         *key = QString::number(mReader.toUnsignedInteger());
+         return mReader.next();
+      }
+      *key = QCborValue::fromCbor(mReader).toDiagnosticNotation();
+      return mReader.lastError() == QCborError::NoError;
+   }
+
+   bool readString(QString* text)
+   {
+      auto chunk = mReader.readString();
+      while (chunk.status == QCborStreamReader::Ok) {
+         *text += chunk.data;
+         chunk = mReader.readString();
+      }
+      return chunk.status != QCborStreamReader::Error;
+   }
+
+   QCborStreamReader& mReader;
+   QJsonTreeArena* mArena;
+};
+
+/// Builds QJsonTreeItem nodes straight from MessagePack bytes. Binary and
+/// extension data become base64url text, and keys that are not strings
+/// the text of their value.
+class QJsonMsgPackReader
+{
+public:
+   QJsonMsgPackReader(const char* begin, const char* end, QJsonTreeArena* arena)
+      : mPos(reinterpret_cast<const uchar*>(begin))
+      , mEnd(reinterpret_cast<const uchar*>(end))
+      , mArena(arena)
+   {
+   }
+
+   bool atEnd() const { return mPos == mEnd; }
+   qint64 offset(const char* begin) const { return mPos - reinterpret_cast<const uchar*>(begin); }
+
+   bool readItem(QJsonTreeItem* item, int depth = 0)
+   {
+      if (mPos == mEnd) {
+         return false;
+      }
+      const uchar c = *mPos++;
+
+      if (c <= 0x7f) {
+         item->setInteger(c);
+         return true;
+      }
+      if (c >= 0xe0) {
+         item->setInteger(qint8(c));
+         return true;
+      }
+      if ((c & 0xf0) == 0x80) {
+         return readContainer(item, true, c & 0x0f, depth);
+      }
+      if ((c & 0xf0) == 0x90) {
+         return readContainer(item, false, c & 0x0f, depth);
+      }
+      if ((c & 0xe0) == 0xa0) {
+         return readString(item, c & 0x1f);
+      }
+
+      quint64 value = 0;
+      switch (c) {
+      case 0xc0:
+         return true;
+      case 0xc2:
+      case 0xc3:
+         item->setValue(c == 0xc3);
+         return true;
+      case 0xc4:
+      case 0xc5:
+      case 0xc6:
+         return readNumber(1 << (c - 0xc4), &value) && readBinary(item, value);
+      case 0xc7:
+      case 0xc8:
+      case 0xc9:
+         // the type byte of an extension follows its length
+         return readNumber(1 << (c - 0xc7), &value) && take(1) && readBinary(item, value);
+      case 0xca: {
+         float f;
+         if (!readNumber(4, &value)) {
+            return false;
+         }
+         const quint32 bits = quint32(value);
+         std::memcpy(&f, &bits, sizeof(f));
+         item->setValue(double(f));
+         return true;
+      }
+      case 0xcb: {
+         double d;
+         if (!readNumber(8, &value)) {
+            return false;
+         }
+         std::memcpy(&d, &value, sizeof(d));
+         item->setValue(d);
+         return true;
+      }
+      case 0xcc:
+      case 0xcd:
+      case 0xce:
+      case 0xcf:
+         if (!readNumber(1 << (c - 0xcc), &value)) {
+            return false;
+         }
+         if (value > quint64(std::numeric_limits<qint64>::max())) {
+            item->setUnsigned(value);
+         }
+         else {
+            item->setInteger(qint64(value));
+         }
+         return true;
+      case 0xd0:
+      case 0xd1:
+      case 0xd2:
+      case 0xd3: {
+         const int size = 1 << (c - 0xd0);
+         if (!readNumber(size, &value)) {
+            return false;
+         }
+         // sign extends the big endian value
+         const int shift = 64 - 8 * size;
+         item->setInteger(qint64(value << shift) >> shift);
+         return true;
+      }
+      case 0xd4:
+      case 0xd5:
+      case 0xd6:
+      case 0xd7:
+      case 0xd8:
+         return take(1) && readBinary(item, quint64(1) << (c - 0xd4));
+      case 0xd9:
+      case 0xda:
+      case 0xdb:
+         return readNumber(1 << (c - 0xd9), &value) && readString(item, value);
+      case 0xdc:
+      case 0xdd:
+         return readNumber(c == 0xdc ? 2 : 4, &value) && readContainer(item, false, value, depth);
+      case 0xde:
+      case 0xdf:
+         return readNumber(c == 0xde ? 2 : 4, &value) && readContainer(item, true, value, depth);
+      default:
+         // 0xc1 is never used
+         return false;
+      }
+   }
+
+private:
+   bool readContainer(QJsonTreeItem* item, bool object, quint64 count, int depth)
+   {
+      // every element takes at least a byte, which bounds a forged count
+      if (depth >= MaxNestingDepth || count > quint64(mEnd - mPos)) {
+         return false;
+      }
+      item->setType(object ? QJsonValue::Object : QJsonValue::Array);
+
+      QVector<QJsonTreeItem*> members;
+      bool success = true;
+      for (quint64 i = 0; success && i < count; ++i) {
+         auto child = QJsonTreeItem::create(item, mArena);
+         if (object) {
+            members.append(child);
+            QJsonTreeItem key;
+            success = !isContainer() && readItem(&key, depth + 1);
+            child->setKey(mArena->keys().intern(key.value().toString()));
+         }
+         else {
+            item->appendChild(child);
+         }
+         success = success && readItem(child, depth + 1);
+      }
+
+      if (!success) {
+         for (auto member : members) {
+            QJsonTreeItem::destroy(member, mArena);
+         }
+         return false;
+      }
+      appendMembers(item, members, mArena);
+      return true;
+   }
+
+   bool isContainer() const
+   {
+      const uchar c = mPos < mEnd ? *mPos : 0xc1;
+      return (c & 0xe0) == 0x80 || (c >= 0xdc && c <= 0xdf);
+   }
+
+   bool readString(QJsonTreeItem* item, quint64 length)
+   {
+      if (length > quint64(mEnd - mPos)) {
+         return false;
+      }
+      const char* begin = reinterpret_cast<const char*>(mPos);
+      if (isVerbatimUtf8(begin, begin + length)) {
+         item->setUtf8Value(begin, begin + length);
+      }
+      else {
+         item->setValue(utf8ToString(begin, begin + length));
+      }
+      mPos += length;
+      return true;
+   }
+
+   bool readBinary(QJsonTreeItem* item, quint64 length)
+   {
+      if (length > quint64(mEnd - mPos)) {
+         return false;
+      }
+      item->setValue(binaryToString(QByteArray::fromRawData(reinterpret_cast<const char*>(mPos), int(length))));
+      mPos += length;
+      return true;
+   }
+
+   bool readNumber(int size, quint64* value)
+   {
+      if (mEnd - mPos < size) {
+         return false;
+      }
+      *value = 0;
+      for (int i = 0; i < size; ++i) {
+         *value = (*value << 8) | *mPos++;
+      }
+      return true;
+   }
+
+   bool take(int size)
+   {
+      if (mEnd - mPos < size) {
+         return false;
+      }
+      mPos += size;
+      return true;
+   }
+
+   const uchar* mPos;
+   const uchar* mEnd;
+   QJsonTreeArena* mArena;
+};
+
+//=========================================================================
+
+// A snapshot is the tree in a binary form that is read in place, children
+// decoded only when a lazy item fetches them. All numbers are little endian.
+//
+//   header    "QJSN", quint32 version
+//   bodies    strings:    quint32 length, UTF-8 bytes
+//             containers: quint32 count, quint32 0, count slots
+//   keys      quint32 count, then quint32 length and UTF-8 bytes per key
+//   trailer   root slot, quint64 offset of the keys, quint64 snapshot size
+//
+// A slot is 16 bytes: quint32 key id (SnapshotNoKey outside objects), quint8
+// tag, 3 bytes 0, and a quint64 payload that holds a scalar inline or the
+// offset of its body. Bodies are written after the bodies of their children,
+// so a snapshot is written front to back in one pass.
+
+enum SnapshotTag : quint8
+{
+   SnapshotNull,
+   SnapshotFalse,
+   SnapshotTrue,
+   SnapshotInteger,    // qint64 payload
+   SnapshotUnsigned,   // quint64 payload
+   SnapshotDouble,     // payload holds the bits of the double
+   SnapshotString,     // a string JSON needs escaped
+   SnapshotUtf8String, // a string written as it is
+   SnapshotNumberText, // a number kept as its JSON text
+   SnapshotObject,
+   SnapshotArray
+};
+
+struct QJsonSnapshotSlot
+{
+   quint32 key;
+   quint8 tag;
+   quint64 payload;
+};
+
+static QJsonSnapshotSlot readSnapshotSlot(const char* p)
+{
+   QJsonSnapshotSlot slot;
+   slot.key = qFromLittleEndian<quint32>(p);
+   slot.tag = quint8(p[4]);
+   slot.payload = qFromLittleEndian<quint64>(p + 8);
+   return slot;
+}
+
+/// A snapshot being read: its bytes, which the model keeps alive, and its
+/// key table, decoded once on load.
+struct QJsonSnapshot
+{
+   QJsonSnapshot()
+      : begin(nullptr)
+      , end(nullptr)
+      , root(nullptr)
+   {
+   }
+
+   /// Checks the header, trailer and key table of \a data.
+   bool open(const QByteArray& data)
+   {
+      begin = data.constData();
+      end = begin + data.size();
+      const qint64 size = data.size();
+      if (size < SnapshotHeaderSize + SnapshotTrailerSize || qstrncmp(begin, SnapshotMagic, 4) != 0
+          || qFromLittleEndian<quint32>(begin + 4) != SnapshotVersion) {
+         return false;
+      }
+      const char* trailer = end - SnapshotTrailerSize;
+      if (qFromLittleEndian<quint64>(trailer + SnapshotSlotSize + 8) != quint64(size)) {
+         return false;
+      }
+      root = trailer;
+
+      quint64 offset = qFromLittleEndian<quint64>(trailer + SnapshotSlotSize);
+      quint32 count = 0;
+      if (!read(offset, &count) || count > quint64(size) / 4) {
+         return false;
+      }
+      offset += 4;
+      keys.reserve(int(count));
+      for (quint32 i = 0; i < count; ++i) {
+         const char* bytes = nullptr;
+         int length = 0;
+         if (!text(offset, &bytes, &length)) {
+            return false;
+         }
+         keys.append(utf8ToString(bytes, bytes + length));
+         offset += 4 + quint64(length);
+      }
+      return true;
+   }
+
+   bool read(quint64 offset, quint32* value) const
+   {
+      if (offset > quint64(end - begin) || quint64(end - begin) - offset < 4) {
+         return false;
+      }
+      *value = qFromLittleEndian<quint32>(begin + offset);
+      return true;
+   }
+
+   /// The string body at \a offset, or false if it runs past the snapshot.
+   bool text(quint64 offset, const char** text, int* length) const
+   {
+      quint32 size = 0;
+      if (!read(offset, &size) || quint64(end - begin) - offset - 4 < size) {
+         return false;
+      }
+      *text = begin + offset + 4;
+      *length = int(size);
+      return true;
+   }
+
+   /// The slots of the container body at \a offset.
+   bool container(quint64 offset, const char** entries, int* count) const
+   {
+      quint32 size = 0;
+      if (!read(offset, &size) || quint64(end - begin) - offset - 4 < 4 + quint64(size) * SnapshotSlotSize) {
+         return false;
+      }
+      *entries = begin + offset + 8;
+      *count = int(size);
+      return true;
+   }
+
+   /// Checks every slot once, so items built from the snapshot later can
+   /// trust it: known tags, keys for object members, bodies inside the
+   /// snapshot, strings JSON may copy as they are, numbers in JSON syntax,
+   /// and each container body below the body of its parent, as the writer
+   /// puts it, so no container holds itself. A snapshot that visits more
+   /// slots than it could hold shares bodies and is rejected as well.
+   bool validate() const
+   {
+      struct Entry
+      {
+         const char* slot;
+         quint64 limit;
+         int depth;
+         bool member;
+      };
+      QVector<Entry> stack;
+      stack.append({root, quint64(root - begin), 0, false});
+      quint64 visited = 0;
+      while (!stack.isEmpty()) {
+         const Entry entry = stack.takeLast();
+         const QJsonSnapshotSlot slot = readSnapshotSlot(entry.slot);
+         if (++visited > quint64(end - begin) / SnapshotSlotSize
+             || (entry.member && slot.key >= quint32(keys.size()))) {
+            return false;
+         }
+
+         const char* bytes = nullptr;
+         int length = 0;
+         const char* entries = nullptr;
+         int count = 0;
+         switch (slot.tag) {
+         case SnapshotNull:
+         case SnapshotFalse:
+         case SnapshotTrue:
+         case SnapshotInteger:
+         case SnapshotUnsigned:
+         case SnapshotDouble:
+            break;
+         case SnapshotString:
+            if (!text(slot.payload, &bytes, &length)) {
+               return false;
+            }
+            break;
+         case SnapshotUtf8String:
+            if (!text(slot.payload, &bytes, &length) || !isVerbatimUtf8(bytes, bytes + length)) {
+               return false;
+            }
+            break;
+         case SnapshotNumberText: {
+            if (!text(slot.payload, &bytes, &length)) {
+               return false;
+            }
+            QJsonReader reader(bytes, bytes + length);
+            double number = 0;
+            if (!reader.parseNumber(&number) || !reader.atEnd()) {
+               return false;
+            }
+            break;
+         }
+         case SnapshotObject:
+         case SnapshotArray:
+            if (entry.depth >= MaxNestingDepth || slot.payload >= entry.limit
+                || !container(slot.payload, &entries, &count)) {
+               return false;
+            }
+            for (int i = 0; i < count; ++i) {
+               stack.append({entries + i * SnapshotSlotSize, slot.payload, entry.depth + 1, SnapshotObject == slot.tag});
+            }
+            break;
+         default:
+            return false;
+         }
+      }
+      return true;
+   }
+
+   const char* begin;
+   const char* end;
+   const char* root;
+   QVector<QString> keys;
+};
+
+//=========================================================================
+
+/// Source of the children a lazy item has not created yet: a QJsonValue,
+/// a byte range of the raw text the model was loaded from, or the slots of
+/// a snapshot.
+struct QJsonTreeItem::Pending
+{
+   explicit Pending(const QJsonValue& value)
+      : value(value)
+      , begin(nullptr)
+      , end(nullptr)
+      , snapshot(nullptr)
+      , entries(nullptr)
+      , count(0)
+      , indexed(false)
+      , next(0)
+   {
+   }
+
+   Pending(const char* begin, const char* end)
+      : begin(begin)
+      , end(end)
+      , snapshot(nullptr)
+      , entries(nullptr)
+      , count(0)
+      , indexed(false)
+      , next(0)
+   {
+   }
+
+   Pending(const QJsonSnapshot* snapshot, const char* entries, int count)
+      : begin(nullptr)
+      , end(nullptr)
+      , snapshot(snapshot)
+      , entries(entries)
+      , count(count)
+      , indexed(false)
+      , next(0)
+   {
+   }
+
+   bool isRaw() const { return begin != nullptr; }
+   bool isSnapshot() const { return snapshot != nullptr; }
+
+   int size()
+   {
+      if (isSnapshot()) {
+         return count;
+      }
+      if (!isRaw()) {
+         return value.isObject() ? value.toObject().size() : value.toArray().size();
+      }
+      if (!indexed) {
+         indexed = true;
+         if (!indexRaw(begin, end, members)) {
+            members.clear();
+         }
+      }
+      return members.size();
+   }
+
+   QJsonValue value;
+   const char* begin;
+   const char* end;
+   const QJsonSnapshot* snapshot;
+   const char* entries;
+   int count;
+   QVector<QJsonRawMember> members;
+   bool indexed;
+   int next;
+};
+
+/// What only objects and arrays need, kept out of scalar items: their
+/// children and the source of those not fetched yet.
+struct QJsonTreeItem::Container
+{
+   Container()
+      : pending(nullptr)
+   {
+   }
+
+   ~Container()
+   {
+      delete pending;
+   }
+
+   QList<QJsonTreeItem*> childs;
+   Pending* pending;
+};
+
+QJsonTreeItem::QJsonTreeItem(QJsonTreeItem* parent)
+   : mParent(parent)
+   , mContainer(nullptr)
+   , mRow(0)
+   , mSlot(-1)
+   , mType(QJsonValue::Null)
+   , mStorage(Plain)
+{
+}
+
+QJsonTreeItem::~QJsonTreeItem()
+{
+   releaseValue();
+}
+
+QJsonTreeItem* QJsonTreeItem::create(QJsonTreeItem* parent, QJsonTreeArena* arena)
+{
+   return arena ? arena->create(parent) : new QJsonTreeItem(parent);
+}
+
+void QJsonTreeItem::destroy(QJsonTreeItem* item, QJsonTreeArena* arena)
+{
+   if (arena) {
+      arena->destroy(item);
+   }
+   else {
+      delete item;
+   }
+}
+
+void QJsonTreeItem::appendChild(QJsonTreeItem* item)
+{
+   auto& childs = mutableChilds();
+   item->mParent = this;
+   item->mRow = childs.count();
+   childs.append(item);
+}
+
+void QJsonTreeItem::insertChild(int row, QJsonTreeItem* item)
+{
+   auto& childs = mutableChilds();
+   item->mParent = this;
+   childs.insert(row, item);
+   updateRows(row, childs.count() - 1);
+}
+
+QJsonTreeItem* QJsonTreeItem::takeChild(int row)
+{
+   if (row < 0 || row >= childCount()) {
+      return nullptr;
+   }
+
+   auto& childs = mutableChilds();
+   auto item = childs.takeAt(row);
+   item->mParent = nullptr;
+   item->mRow = 0;
+   updateRows(row, childs.count() - 1);
+   return item;
+}
+
+void QJsonTreeItem::insertChildren(int row, const QList<QJsonTreeItem*>& items)
+{
+   Q_ASSERT(row >= 0 && row <= childCount());
+   for (auto item : items) {
+      item->mParent = this;
+   }
+   // one splice, rather than moving the tail once per item
+   auto& current = mutableChilds();
+   QList<QJsonTreeItem*> childs;
+   childs.reserve(current.count() + items.count());
+   childs.append(current.mid(0, row));
+   childs.append(items);
+   childs.append(current.mid(row));
+   current.swap(childs);
+   updateRows(row, current.count() - 1);
+}
+
+QList<QJsonTreeItem*> QJsonTreeItem::takeChildren(int row, int count)
+{
+   if (row < 0 || count <= 0 || row + count > childCount()) {
+      return QList<QJsonTreeItem*>();
+   }
+
+   auto& childs = mutableChilds();
+   const auto items = childs.mid(row, count);
+   childs.erase(childs.begin() + row, childs.begin() + row + count);
+   for (auto item : items) {
+      item->mParent = nullptr;
+      item->mRow = 0;
+   }
+   updateRows(row, childs.count() - 1);
+   return items;
+}
+
+void QJsonTreeItem::removeChildren(int row, int count, QJsonTreeArena* arena)
+{
+   for (auto item : takeChildren(row, count)) {
+      destroy(item, arena);
+   }
+}
+
+void QJsonTreeItem::moveChild(int from, int to)
+{
+   if (from == to) {
+      return;
+   }
+
+   mutableChilds().move(from, to);
+   updateRows(qMin(from, to), qMax(from, to));
+}
+
+QJsonTreeItem* QJsonTreeItem::child(int row)
+{
+   return childs().value(row);
+}
+
+QJsonTreeItem* QJsonTreeItem::parent()
+{
+   return mParent;
+}
+
+int QJsonTreeItem::childCount() const
+{
+   return childs().count();
+}
+
+int QJsonTreeItem::row() const
+{
+   return mParent ? mRow : 0;
+}
+
+void QJsonTreeItem::updateRows(int first, int last)
+{
+   const auto& items = childs();
+   for (int i = first; i <= last; ++i) {
+      items.at(i)->mRow = i;
+   }
+}
+
+/// Whether items of \a type keep mContainer in the union. Null items do too,
+/// as loaders add children before they set the type.
+bool QJsonTreeItem::holdsChildren(QJsonValue::Type type)
+{
+   return QJsonValue::Bool != type && QJsonValue::Double != type && QJsonValue::String != type;
+}
+
+const QList<QJsonTreeItem*>& QJsonTreeItem::childs() const
+{
+   static const QList<QJsonTreeItem*> none;
+   return holdsChildren(mType) && mContainer ? mContainer->childs : none;
+}
+
+QList<QJsonTreeItem*>& QJsonTreeItem::mutableChilds()
+{
+   Q_ASSERT(holdsChildren(mType));
+   if (!mContainer) {
+      mContainer = new Container;
+   }
+   return mContainer->childs;
+}
+
+QJsonTreeItem::Pending* QJsonTreeItem::pending() const
+{
+   return holdsChildren(mType) && mContainer ? mContainer->pending : nullptr;
+}
+
+void QJsonTreeItem::setPending(Pending* pending)
+{
+   Q_ASSERT(holdsChildren(mType));
+   if (!mContainer) {
+      mContainer = new Container;
+   }
+   delete mContainer->pending;
+   mContainer->pending = pending;
+}
+
+void QJsonTreeItem::setKey(const QString& key)
+{
+   mKey = key;
+}
+
+void QJsonTreeItem::setValue(const QVariant& value)
+{
+   if (QJsonValue::Object == mType || QJsonValue::Array == mType) {
+      return;
+   }
+
+   releaseValue();
+
+   switch (value.userType()) {
+   case QMetaType::UnknownType:
+   case QMetaType::Nullptr:
+      mType = QJsonValue::Null;
+      mContainer = nullptr;
+      break;
+   case QMetaType::Bool:
+      mType = QJsonValue::Bool;
+      mBool = value.toBool();
+      break;
+   case QMetaType::Int:
+   case QMetaType::UInt:
+   case QMetaType::LongLong:
+      setInteger(value.toLongLong());
+      break;
+   case QMetaType::ULongLong:
+      if (value.toULongLong() > quint64(std::numeric_limits<qint64>::max())) {
+         setUnsigned(value.toULongLong());
+      }
+      else {
+         setInteger(qint64(value.toULongLong()));
+      }
+      break;
+   case QMetaType::Double:
+   case QMetaType::Float:
+      mType = QJsonValue::Double;
+      mDouble = value.toDouble();
+      break;
+   default:
+      mType = QJsonValue::String;
+      new (&mString) QString(value.toString());
+   }
+}
+
+void QJsonTreeItem::setType(const QJsonValue::Type& type)
+{
+   if (type == mType) {
+      return;
+   }
+   // children stay when an object becomes an array or the other way round
+   if (holdsChildren(mType) && holdsChildren(type)) {
+      mType = type;
+      return;
+   }
+
+   // a scalar keeps its value, converted to the new type
+   const QVariant current = value();
+   releaseValue();
+   mType = type;
+
+   switch (type) {
+   case QJsonValue::Bool:
+      mBool = current.toBool();
+      break;
+   case QJsonValue::Double:
+      mDouble = current.toDouble();
+      break;
+   case QJsonValue::String:
+      new (&mString) QString(current.toString());
+      break;
+   default:
+      mContainer = nullptr;
+      break;
+   }
+}
+
+QString QJsonTreeItem::key() const
+{
+   // array elements do not store a key, their index is their key
+   if (mParent && QJsonValue::Array == mParent->mType) {
+      return QString::number(mRow);
+   }
+   return mKey;
+}
+
+QVariant QJsonTreeItem::value() const
+{
+   switch (mType) {
+   case QJsonValue::Bool:
+      return mBool;
+   case QJsonValue::Double:
+      switch (mStorage) {
+      case Integer:
+         // a double holds these exactly, and is what views expect of JSON
+         if (mInteger >= -MaxSafeInteger && mInteger <= MaxSafeInteger) {
+            return double(mInteger);
+         }
+         return mInteger;
+      case Unsigned:
+         return mUnsigned;
+      case Utf8:
+         return readDouble(mUtf8.constData(), mUtf8.constData() + mUtf8.size());
+      default:
+         return mDouble;
+      }
+   case QJsonValue::String:
+      return Utf8 == mStorage ? utf8ToString(mUtf8.constData(), mUtf8.constData() + mUtf8.size()) : mString;
+   case QJsonValue::Null:
+      return QJsonValue().toVariant();
+   default:
+      return QVariant();
+   }
+}
+
+QJsonValue::Type QJsonTreeItem::type() const
+{
+   return mType;
+}
+
+void QJsonTreeItem::releaseValue()
+{
+   if (Utf8 == mStorage) {
+      mUtf8.~QByteArray();
+   }
+   else if (QJsonValue::String == mType) {
+      mString.~QString();
+   }
+   else if (holdsChildren(mType) && mContainer) {
+      // children of arena items are released by their arena
+      if (mSlot < 0) {
+         qDeleteAll(mContainer->childs);
+      }
+      delete mContainer;
+      mContainer = nullptr;
+   }
+   mStorage = Plain;
+}
+
+/// Makes the item a string given by its UTF-8 bytes, which the caller
+/// checked to be valid and to need no escaping in JSON, or a number given
+/// by its JSON text.
+void QJsonTreeItem::setUtf8Value(const char* begin, const char* end, QJsonValue::Type type)
+{
+   releaseValue();
+   mType = type;
+   mStorage = Utf8;
+   new (&mUtf8) QByteArray(begin, int(end - begin));
+}
+
+QByteArray QJsonTreeItem::utf8Value() const
+{
+   if (QJsonValue::String != mType) {
+      return QByteArray();
+   }
+   return Utf8 == mStorage ? mUtf8 : mString.toUtf8();
+}
+
+/// Takes the scalar of \a other, stored the same way, but none of its
+/// children.
+void QJsonTreeItem::copyValue(const QJsonTreeItem& other)
+{
+   releaseValue();
+   mType = other.mType;
+   mStorage = other.mStorage;
+   if (Utf8 == mStorage) {
+      new (&mUtf8) QByteArray(other.mUtf8);
+   }
+   else if (Integer == mStorage) {
+      mInteger = other.mInteger;
+   }
+   else if (Unsigned == mStorage) {
+      mUnsigned = other.mUnsigned;
+   }
+   else if (QJsonValue::String == mType) {
+      new (&mString) QString(other.mString);
+   }
+   else if (QJsonValue::Bool == mType) {
+      mBool = other.mBool;
+   }
+   else if (QJsonValue::Double == mType) {
+      mDouble = other.mDouble;
+   }
+   else {
+      mContainer = nullptr;
+   }
+}
+
+void QJsonTreeItem::setInteger(qint64 value)
+{
+   releaseValue();
+   mType = QJsonValue::Double;
+   mStorage = Integer;
+   mInteger = value;
+}
+
+void QJsonTreeItem::setUnsigned(quint64 value)
+{
+   releaseValue();
+   mType = QJsonValue::Double;
+   mStorage = Unsigned;
+   mUnsigned = value;
+}
+
+/// Writes the number the item holds, never rounding it through a double.
+void QJsonTreeItem::numberToJson(QByteArray& json) const
+{
+   switch (mStorage) {
+   case Integer:
+      integerToJson(mInteger < 0 ? quint64(0) - quint64(mInteger) : quint64(mInteger), mInteger < 0, json);
+      break;
+   case Unsigned:
+      integerToJson(mUnsigned, false, json);
+      break;
+   case Utf8:
+      json += mUtf8;
+      break;
+   default:
+      doubleToJson(mDouble, json);
+   }
+}
+
+int QJsonTreeItem::pendingCount() const
+{
+   Pending* source = pending();
+   if (!source) {
+      return 0;
+   }
+
+   return source->size() - source->next;
+}
+
+bool QJsonTreeItem::canFetchMore() const
+{
+   return pending() != nullptr;
+}
+
+int QJsonTreeItem::fetchMore(int count, QJsonTreeArena* arena)
+{
+   Pending* source = pending();
+   if (!source) {
+      return 0;
+   }
+
+   const int size = source->next + pendingCount();
+   const int end = qMin(size, source->next + count);
+   int fetched = 0;
+   for (int i = source->next; i < end; ++i) {
+      appendChild(loadPending(i, this, arena));
+      ++fetched;
+   }
+
+   source->next += fetched;
+   if (source->next >= size) {
+      setPending(nullptr);
+   }
+
+   return fetched;
+}
+
+/// Creates the pending child \a index, lazy itself, with its key if it is an
+/// object member. Does not add it to the children.
+QJsonTreeItem* QJsonTreeItem::loadPending(int index, QJsonTreeItem* parent, QJsonTreeArena* arena) const
+{
+   const Pending* source = pending();
+   if (source->isSnapshot()) {
+      return loadSlot(source->snapshot, source->entries + index * SnapshotSlotSize, parent, arena);
+   }
+
+   QJsonTreeItem* child = nullptr;
+   if (source->isRaw()) {
+      const auto& member = source->members.at(index);
+      child = loadLazy(member.begin, member.end, parent, arena);
+      if (QJsonValue::Object == mType) {
+         child->setKey(arena ? arena->keys().intern(member.key) : member.key);
+      }
+   }
+   else if (QJsonValue::Object == mType) {
+      const auto object = source->value.toObject();
+      const auto it = object.constBegin() + index;
+      child = loadLazy(it.value(), parent, arena);
+      child->setKey(arena ? arena->keys().intern(it.key()) : it.key());
+   }
+   else {
+      child = loadLazy(source->value.toArray().at(index), parent, arena);
+   }
+   return child;
+}
+
+/// Calls \a function with each child, including those a lazy item has not
+/// fetched: these are built one at a time and dropped afterwards.
+template <typename Function>
+void QJsonTreeItem::forEachChild(Function function) const
+{
+   for (const QJsonTreeItem* child : childs()) {
+      function(child);
+   }
+   const int count = pendingCount();
+   const int first = count > 0 ? pending()->next : 0;
+   for (int i = first; i < first + count; ++i) {
+      QScopedPointer<QJsonTreeItem> child(loadPending(i, nullptr, nullptr));
+      function(child.data());
+   }
+}
+
+QJsonTreeItem* QJsonTreeItem::load(const QJsonValue& value, QJsonTreeItem* parent, QJsonTreeArena* arena)
+{
+   auto rootItem = create(parent, arena);
+   if (!parent) {
+      rootItem->setKey(QStringLiteral("root"));
+   }
+
+   if (value.isObject())
+   {
+      const auto object = value.toObject();
+      for(auto it=object.constBegin(); it!=object.constEnd(); ++it){
+         auto value = it.value();
+         QJsonTreeItem* child = load(value, rootItem, arena);
+         child->setKey(arena ? arena->keys().intern(it.key()) : it.key());
+         child->setType(value.type());
+         rootItem->appendChild(child);
+      }
+   }
+
+   else if (value.isArray())
+   {
+      const auto array = value.toArray();
+      for (const auto& v : array)
+      {
+         QJsonTreeItem* child = load(v, rootItem, arena);
+         child->setType(v.type());
+         rootItem->appendChild(child);
+      }
+   }
+   else
+   {
+      rootItem->setValue(value.toVariant());
+      rootItem->setType(value.type());
+   }
+
+   return rootItem;
+}
+
+QJsonTreeItem* QJsonTreeItem::loadLazy(const QJsonValue& value, QJsonTreeItem* parent, QJsonTreeArena* arena)
+{
+   auto rootItem = create(parent, arena);
+   if (!parent) {
+      rootItem->setKey(QStringLiteral("root"));
+   }
+   rootItem->setType(value.type());
+
+   const bool pending = value.isObject() ? !value.toObject().isEmpty()
+                                         : value.isArray() && !value.toArray().isEmpty();
+   if (pending) {
+      rootItem->setPending(new Pending(value));
+   }
+   else if (!value.isObject() && !value.isArray()) {
+      rootItem->setValue(value.toVariant());
+   }
+
+   return rootItem;
+}
+
+QJsonTreeItem* QJsonTreeItem::loadLazy(const char* begin, const char* end, QJsonTreeItem* parent, QJsonTreeArena* arena)
+{
+   auto rootItem = create(parent, arena);
+   if (!parent) {
+      rootItem->setKey(QStringLiteral("root"));
+   }
+
+   QJsonReader reader(begin, end);
+   reader.skipWhitespace();
+   const char c = reader.peek();
+
+   if (c == '{' || c == '[') {
+      rootItem->setType(c == '{' ? QJsonValue::Object : QJsonValue::Array);
+      reader.advance();
+      reader.skipWhitespace();
+      if (!reader.consume(c == '{' ? '}' : ']')) {
+         rootItem->setPending(new Pending(begin, end));
+      }
+   }
+   else {
+      reader.parseScalarItem(rootItem);
+   }
+
+   return rootItem;
+}
+
+/// Creates an item from a slot of \a snapshot; the children of a container
+/// stay in the snapshot until fetched. Keys come from the key table, which
+/// the model interned into its pool on load. The snapshot was validated when
+/// it was opened.
+QJsonTreeItem* QJsonTreeItem::loadSlot(const QJsonSnapshot* snapshot, const char* slot, QJsonTreeItem* parent, QJsonTreeArena* arena)
+{
+   auto rootItem = create(parent, arena);
+   const QJsonSnapshotSlot value = readSnapshotSlot(slot);
+   if (value.key < quint32(snapshot->keys.size())) {
+      rootItem->setKey(snapshot->keys.at(int(value.key)));
+   }
+   else if (!parent) {
+      rootItem->setKey(QStringLiteral("root"));
+   }
+
+   const char* text = nullptr;
+   int length = 0;
+   switch (value.tag) {
+   case SnapshotFalse:
+   case SnapshotTrue:
+      rootItem->setValue(SnapshotTrue == value.tag);
+      break;
+   case SnapshotInteger:
+      rootItem->setInteger(qint64(value.payload));
+      break;
+   case SnapshotUnsigned:
+      rootItem->setUnsigned(value.payload);
+      break;
+   case SnapshotDouble: {
+      double d;
+      std::memcpy(&d, &value.payload, sizeof(double));
+      rootItem->setValue(d);
+      break;
+   }
+   case SnapshotString:
+   case SnapshotUtf8String:
+   case SnapshotNumberText:
+      if (!snapshot->text(value.payload, &text, &length)) {
+         qDebug() << Q_FUNC_INFO << "string past the end of the snapshot";
+      }
+      else if (SnapshotString == value.tag) {
+         rootItem->setValue(utf8ToString(text, text + length));
+      }
+      else {
+         rootItem->setUtf8Value(text, text + length, SnapshotNumberText == value.tag ? QJsonValue::Double : QJsonValue::String);
+      }
+      break;
+   case SnapshotObject:
+   case SnapshotArray: {
+      rootItem->setType(SnapshotObject == value.tag ? QJsonValue::Object : QJsonValue::Array);
+      const char* entries = nullptr;
+      int count = 0;
+      if (!snapshot->container(value.payload, &entries, &count)) {
+         qDebug() << Q_FUNC_INFO << "container past the end of the snapshot";
+      }
+      else if (count > 0) {
+         rootItem->setPending(new Pending(snapshot, entries, count));
+      }
+      break;
+   }
+   default:
+      break;
+   }
+
+   return rootItem;
+}
+
+/// Writes a snapshot of a tree to a device, SaveChunkSize bytes at a time.
+/// Children a lazy item has not fetched are built one at a time and dropped
+/// once written.
+class QJsonSnapshotWriter
+{
+public:
+   explicit QJsonSnapshotWriter(QIODevice* device)
+      : mDevice(device)
+      , mOffset(0)
+      , mFailed(false)
+   {
+      mBuffer.reserve(2 * SaveChunkSize);
+   }
+
+   bool write(const QJsonTreeItem* root)
+   {
+      append(SnapshotMagic, 4);
+      appendNumber(SnapshotVersion);
+      const QJsonSnapshotSlot slot = writeItem(root);
+
+      const quint64 keys = mOffset;
+      appendNumber(quint32(mKeys.size()));
+      for (const QString& key : mKeys) {
+         appendText(key.toUtf8());
+      }
+      appendSlot(slot);
+      appendNumber(keys);
+      appendNumber(mOffset + 8);
+      flush(true);
+      return !mFailed;
+   }
+
+private:
+   QJsonSnapshotSlot writeItem(const QJsonTreeItem* item)
+   {
+      QJsonSnapshotSlot slot = {SnapshotNoKey, SnapshotNull, 0};
+      switch (item->mType) {
+      case QJsonValue::Bool:
+         slot.tag = item->mBool ? SnapshotTrue : SnapshotFalse;
+         break;
+      case QJsonValue::Double:
+         if (QJsonTreeItem::Integer == item->mStorage) {
+            slot.tag = SnapshotInteger;
+            slot.payload = quint64(item->mInteger);
+         }
+         else if (QJsonTreeItem::Unsigned == item->mStorage) {
+            slot.tag = SnapshotUnsigned;
+            slot.payload = item->mUnsigned;
+         }
+         else if (QJsonTreeItem::Utf8 == item->mStorage) {
+            slot.tag = SnapshotNumberText;
+            slot.payload = appendText(item->mUtf8);
+         }
+         else {
+            slot.tag = SnapshotDouble;
+            std::memcpy(&slot.payload, &item->mDouble, sizeof(double));
+         }
+         break;
+      case QJsonValue::String:
+         if (QJsonTreeItem::Utf8 == item->mStorage) {
+            slot.tag = SnapshotUtf8String;
+            slot.payload = appendText(item->mUtf8);
+         }
+         else {
+            slot.tag = SnapshotString;
+            slot.payload = appendText(item->mString.toUtf8());
+         }
+         break;
+      case QJsonValue::Object:
+      case QJsonValue::Array:
+         slot.tag = QJsonValue::Object == item->mType ? SnapshotObject : SnapshotArray;
+         slot.payload = writeContainer(item);
+         break;
+      default:
+         break;
+      }
+      return slot;
+   }
+
+   quint64 writeContainer(const QJsonTreeItem* item)
+   {
+      const bool isObject = QJsonValue::Object == item->mType;
+      QVector<QJsonSnapshotSlot> entries;
+      entries.reserve(item->childCount() + item->pendingCount());
+      item->forEachChild([&](const QJsonTreeItem* child) {
+         entries.append(writeItem(child));
+         if (isObject) {
+            entries.last().key = keyId(child->mKey);
+         }
+      });
+
+      const quint64 offset = mOffset;
+      appendNumber(quint32(entries.size()));
+      appendNumber(quint32(0));
+      for (const auto& slot : entries) {
+         appendSlot(slot);
+      }
+      return offset;
+   }
+
+   quint32 keyId(const QString& key)
+   {
+      auto it = mKeyIds.find(key);
+      if (it == mKeyIds.end()) {
+         it = mKeyIds.insert(key, quint32(mKeys.size()));
+         mKeys.append(key);
+      }
+      return it.value();
+   }
+
+   template <typename T>
+   void appendNumber(T value)
+   {
+      char bytes[sizeof(T)];
+      qToLittleEndian(value, bytes);
+      append(bytes, int(sizeof(T)));
+   }
+
+   quint64 appendText(const QByteArray& text)
+   {
+      const quint64 offset = mOffset;
+      appendNumber(quint32(text.size()));
+      append(text.constData(), text.size());
+      return offset;
+   }
+
+   void appendSlot(const QJsonSnapshotSlot& slot)
+   {
+      appendNumber(slot.key);
+      const char tag[4] = {char(slot.tag), 0, 0, 0};
+      append(tag, 4);
+      appendNumber(slot.payload);
+   }
+
+   void append(const char* data, int size)
+   {
+      mBuffer.append(data, size);
+      mOffset += size;
+      flush(false);
+   }
+
+   void flush(bool all)
+   {
+      if (!all && mBuffer.size() < SaveChunkSize) {
+         return;
+      }
+      if (!mFailed && mDevice->write(mBuffer) != mBuffer.size()) {
+         mFailed = true;
+      }
+      // keeps the reserved capacity for the next chunk
+      mBuffer.resize(0);
+   }
+
+   QIODevice* mDevice;
+   QByteArray mBuffer;
+   quint64 mOffset;
+   bool mFailed;
+   QHash<QString, quint32> mKeyIds;
+   QVector<QString> mKeys;
+};
+
+/// Where the writers put their output. When saving to a device, the buffer
+/// is handed to it every SaveChunkSize bytes, so only one chunk plus the
+/// current path through the tree is held in memory.
+struct QJsonSaveSink
+{
+   explicit QJsonSaveSink(QIODevice* device = nullptr)
+      : device(device)
+      , failed(false)
+   {
+      if (device) {
+         buffer.reserve(2 * SaveChunkSize);
+      }
+   }
+
+   void flush(bool all = false)
+   {
+      if (!device || (!all && buffer.size() < SaveChunkSize)) {
+         return;
+      }
+      if (!failed && device->write(buffer) != buffer.size()) {
+         failed = true;
+      }
+      // keeps the reserved capacity for the next chunk
+      buffer.resize(0);
+   }
+
+   /// Hands the rest of the buffer to the device, true if every write did.
+   bool finish()
+   {
+      flush(true);
+      return !failed;
+   }
+
+   QByteArray buffer;
+   QIODevice* device;
+   bool failed;
+};
+
+/// Appends what a QCborStreamWriter encodes to the buffer of a sink.
+class QJsonSaveSinkDevice : public QIODevice
+{
+public:
+   explicit QJsonSaveSinkDevice(QJsonSaveSink& sink)
+      : mSink(sink)
+   {
+      open(QIODevice::WriteOnly | QIODevice::Unbuffered);
+   }
+
+   bool isSequential() const override { return true; }
+
+protected:
+   qint64 readData(char*, qint64) override { return -1; }
+
+   qint64 writeData(const char* data, qint64 size) override
+   {
+      mSink.buffer.append(data, int(size));
+      return size;
+   }
+
+private:
+   QJsonSaveSink& mSink;
+};
+
+//=========================================================================
+
+QJsonKeyPool::QJsonKeyPool()
+{
+}
+
+QString QJsonKeyPool::intern(const QString& key, int* id)
+{
+   auto it = mIds.constFind(key);
+   if (it == mIds.constEnd()) {
+      it = mIds.insert(key, mKeys.count());
+      mKeys.append(key);
+      mUses.append(0);
+   }
+
+   const int index = it.value();
+   ++mUses[index];
+   if (id) {
+      *id = index;
+   }
+   return mKeys.at(index);
+}
+
+int QJsonKeyPool::id(const QString& key) const
+{
+   return mIds.value(key, -1);
+}
+
+QString QJsonKeyPool::key(int id) const
+{
+   return mKeys.value(id);
+}
+
+void QJsonKeyPool::clear()
+{
+   mIds.clear();
+   mKeys.clear();
+   mUses.clear();
+}
+
+void QJsonKeyPool::merge(const QJsonKeyPool& other, QHash<const QChar*, QString>& shared)
+{
+   for (int i = 0; i < other.mKeys.count(); ++i) {
+      const QString& key = other.mKeys.at(i);
+      int index = -1;
+      const QString pooled = intern(key, &index);
+      mUses[index] += other.mUses.at(i) - 1;
+      shared.insert(key.constData(), pooled);
+   }
+}
+
+bool QJsonKeyPool::equal(const QString& a, const QString& b)
+{
+   // interned keys are shared, so only keys from outside the pool
+   // need their characters compared
+   return a.isSharedWith(b) || a == b;
+}
+
+int QJsonKeyPool::count() const
+{
+   return mKeys.count();
+}
+
+qint64 QJsonKeyPool::uses() const
+{
+   qint64 total = 0;
+   for (qint64 uses : mUses) {
+      total += uses;
+   }
+   return total;
+}
+
+qint64 QJsonKeyPool::bytesSaved() const
+{
+   // every use after the first would have allocated its own string data
+   qint64 saved = 0;
+   for (int i = 0; i < mKeys.count(); ++i) {
+      const qint64 size = sizeof(QString::Data) + (mKeys.at(i).size() + 1) * sizeof(QChar);
+      saved += (mUses.at(i) - 1) * size;
+   }
+   return saved;
+}
+
+struct QJsonTreeArena::Block
+{
+   static const int Size = 4096;
+
+   Block()
+   {
+      std::memset(live, 0, sizeof(live));
+   }
+
+   QJsonTreeItem* item(int index)
+   {
+      return reinterpret_cast<QJsonTreeItem*>(&items[index]);
+   }
+
+   typename std::aligned_storage<sizeof(QJsonTreeItem), alignof(QJsonTreeItem)>::type items[Size];
+   quint64 live[Size / 64];
+};
+
+QJsonTreeArena::QJsonTreeArena()
+   : mNextSlot(0)
+   , mCount(0)
+{
+}
+
+QJsonTreeArena::~QJsonTreeArena()
+{
+   clear();
+}
+
+QJsonTreeItem* QJsonTreeArena::create(QJsonTreeItem* parent)
+{
+   int slot;
+   if (!mFreeSlots.isEmpty()) {
+      slot = mFreeSlots.takeLast();
+   }
+   else {
+      if (mNextSlot == mBlocks.count() * Block::Size) {
+         mBlocks.append(new Block);
+      }
+      slot = mNextSlot++;
+   }
+
+   Block* block = mBlocks.at(slot / Block::Size);
+   const int index = slot % Block::Size;
+   auto item = new (block->item(index)) QJsonTreeItem(parent);
+   item->mSlot = slot;
+   block->live[index / 64] |= quint64(1) << (index % 64);
+   ++mCount;
+   return item;
+}
+
+void QJsonTreeArena::destroy(QJsonTreeItem* item)
+{
+   if (!item) {
+      return;
+   }
+
+   for (auto child : item->childs()) {
+      destroy(child);
+   }
+
+   const int slot = item->mSlot;
+   Q_ASSERT(slot >= 0 && slot < mNextSlot);
+   item->~QJsonTreeItem();
+
+   Block* block = mBlocks.at(slot / Block::Size);
+   const int index = slot % Block::Size;
+   block->live[index / 64] &= ~(quint64(1) << (index % 64));
+   mFreeSlots.append(slot);
+   --mCount;
+}
+
+void QJsonTreeArena::clear()
+{
+   // items do not release their children, so every live item is destroyed
+   // exactly once by walking the blocks instead of the tree
+   for (Block* block : mBlocks) {
+      for (int word = 0; word < Block::Size / 64; ++word) {
+         quint64 bits = block->live[word];
+         for (int bit = 0; bits; ++bit, bits >>= 1) {
+            if (bits & 1) {
+               block->item(word * 64 + bit)->~QJsonTreeItem();
+            }
+         }
+      }
+      delete block;
+   }
+
+   mBlocks.clear();
+   mFreeSlots.clear();
+   mNextSlot = 0;
+   mCount = 0;
+   mKeys.clear();
+}
+
+void QJsonTreeArena::merge(QJsonTreeArena& other)
+{
+   if (&other == this || other.mBlocks.isEmpty()) {
+      return;
+   }
+
+   // the unused tail of the last block stays available
+   const int base = mBlocks.count() * Block::Size;
+   for (int slot = base - 1; slot >= mNextSlot; --slot) {
+      mFreeSlots.append(slot);
+   }
+
+   QHash<const QChar*, QString> shared;
+   mKeys.merge(other.mKeys, shared);
+
+   for (Block* block : other.mBlocks) {
+      for (int word = 0; word < Block::Size / 64; ++word) {
+         quint64 bits = block->live[word];
+         for (int bit = 0; bits; ++bit, bits >>= 1) {
+            if (bits & 1) {
+               QJsonTreeItem* item = block->item(word * 64 + bit);
+               item->mSlot += base;
+               // share keys with the equal ones of this arena's pool
+               const auto key = shared.constFind(item->mKey.constData());
+               if (key != shared.constEnd() && !item->mKey.isEmpty()) {
+                  item->mKey = key.value();
+               }
+            }
+         }
+      }
+      mBlocks.append(block);
+   }
+   for (int slot : qAsConst(other.mFreeSlots)) {
+      mFreeSlots.append(slot + base);
+   }
+   mNextSlot = base + other.mNextSlot;
+   mCount += other.mCount;
+
+   other.mBlocks.clear();
+   other.mFreeSlots.clear();
+   other.mNextSlot = 0;
+   other.mCount = 0;
+   other.mKeys.clear();
+}
+
+int QJsonTreeArena::count() const
+{
+   return mCount;
+}
+
+int QJsonTreeArena::blockCount() const
+{
+   return mBlocks.count();
+}
+
+QJsonKeyPool& QJsonTreeArena::keys()
+{
+   return mKeys;
+}
+
+const QJsonKeyPool& QJsonTreeArena::keys() const
+{
+   return mKeys;
+}
+
+//=========================================================================
+
+inline uchar hexdig(uint u)
+{
+    return (u < 0xa ? '0' + u : 'a' + u - 0xa);
+}
+
+// Copies the leading code units of [src, end) that are printable ASCII other
+// than '"' and '\\' to cursor as bytes, returning how many there were. The
+// caller guarantees room for end - src bytes: blocks are stored whole and
+// only the safe part of the last one is kept.
+static int copySafeAscii(const ushort *src, const ushort *end, uchar *cursor)
+{
+    const ushort *const begin = src;
+    // u - 0x20, biased for signed compares, is below 0x60 for 0x20 <= u < 0x80
+#if defined(__AVX2__)
+    const __m256i bias256 = _mm256_set1_epi16(short(0x8000 - 0x20));
+    const __m256i limit256 = _mm256_set1_epi16(short(0x8060));
+    const __m256i quote256 = _mm256_set1_epi16(0x22);
+    const __m256i backslash256 = _mm256_set1_epi16(0x5c);
+    while (end - src >= 16)
+    {
+        const __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src));
+        const __m256i printable = _mm256_cmpgt_epi16(limit256, _mm256_add_epi16(data, bias256));
+        const __m256i special = _mm256_or_si256(_mm256_cmpeq_epi16(data, quote256),
+                                                _mm256_cmpeq_epi16(data, backslash256));
+        const uint safe = uint(_mm256_movemask_epi8(_mm256_andnot_si256(special, printable)));
+        // packing works per 128 bit lane, so gather the two low halves
+        const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(data, data), 0x08);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(cursor), _mm256_castsi256_si128(packed));
+        if (safe != 0xffffffffu)
+        {
+            return int(src - begin) + int(qCountTrailingZeroBits(~safe)) / 2;
+        }
+        src += 16;
+        cursor += 16;
+    }
+#endif
+#if defined(QJSONMODEL_SSE2)
+    const __m128i bias = _mm_set1_epi16(short(0x8000 - 0x20));
+    const __m128i limit = _mm_set1_epi16(short(0x8060));
+    const __m128i quote = _mm_set1_epi16(0x22);
+    const __m128i backslash = _mm_set1_epi16(0x5c);
+    while (end - src >= 8)
+    {
+        const __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+        const __m128i printable = _mm_cmplt_epi16(_mm_add_epi16(data, bias), limit);
+        const __m128i special = _mm_or_si128(_mm_cmpeq_epi16(data, quote), _mm_cmpeq_epi16(data, backslash));
+        const uint safe = uint(_mm_movemask_epi8(_mm_andnot_si128(special, printable)));
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(cursor), _mm_packus_epi16(data, data));
+        if (safe != 0xffffu)
+        {
+            return int(src - begin) + int(qCountTrailingZeroBits(~safe)) / 2;
+        }
+        src += 8;
+        cursor += 8;
+    }
+#endif
+    while (src != end && *src >= 0x20 && *src < 0x80 && *src != 0x22 && *src != 0x5c)
+    {
+        *cursor++ = uchar(*src++);
+    }
+    return int(src - begin);
+}
+
+// Appends s to json escaped and UTF-8 encoded, without the quotes. Room for
+// plain ASCII is made upfront, so only escapes and non-ASCII text can make
+// the buffer grow, and then for all of the remaining text at once.
+void appendEscapedString(const QString &s, QByteArray &json)
+{
+    const int offset = json.size();
+    json.resize(offset + s.length() + 6);
+    uchar *cursor = reinterpret_cast<uchar *>(json.data()) + offset;
+    const uchar *ba_end = reinterpret_cast<const uchar *>(json.constData()) + json.size();
+    const ushort *src = reinterpret_cast<const ushort *>(s.constBegin());
+    const ushort *const end = reinterpret_cast<const ushort *>(s.constEnd());
+    while (src != end)
+    {
+        const int run = copySafeAscii(src, end, cursor);
+        src += run;
+        cursor += run;
+        if (src == end)
+        {
+            break;
+        }
+
+        // keep a byte for every code unit left plus a whole escape
+        if (ba_end - cursor < (end - src) + 6)
+        {
+            const int pos = int(cursor - reinterpret_cast<const uchar *>(json.constData()));
+            // resize() grows the capacity geometrically
+            json.resize(pos + int(end - src) + 6);
+            cursor = reinterpret_cast<uchar *>(json.data()) + pos;
+            ba_end = reinterpret_cast<const uchar *>(json.constData()) + json.size();
+        }
+        uint u = *src++;
+        if (u < 0x80)
+        {
+            *cursor++ = '\\';
+            switch (u)
+            {
+            case 0x22:
+                *cursor++ = '"';
+                break;
+            case 0x5c:
+                *cursor++ = '\\';
+                break;
+            case 0x8:
+                *cursor++ = 'b';
+                break;
+            case 0xc:
+                *cursor++ = 'f';
+                break;
+            case 0xa:
+                *cursor++ = 'n';
+                break;
+            case 0xd:
+                *cursor++ = 'r';
+                break;
+            case 0x9:
+                *cursor++ = 't';
+                break;
+            default:
+                *cursor++ = 'u';
+                *cursor++ = '0';
+                *cursor++ = '0';
+                *cursor++ = hexdig(u >> 4);
+                *cursor++ = hexdig(u & 0xf);
+            }
+        }
+        else if (QUtf8Functions::toUtf8<QUtf8BaseTraits>(u, cursor, src, end) < 0)
+        {
+            // failed to get valid utf8 use JSON escape sequence
+            *cursor++ = '\\';
+            *cursor++ = 'u';
+            *cursor++ = hexdig(u >> 12 & 0x0f);
+            *cursor++ = hexdig(u >> 8 & 0x0f);
+            *cursor++ = hexdig(u >> 4 & 0x0f);
+            *cursor++ = hexdig(u & 0x0f);
+        }
+    }
+    json.resize(int(cursor - reinterpret_cast<const uchar *>(json.constData())));
+}
+
+// Shortest round-trip formatting of doubles with Grisu2 (Florian Loitsch,
+// "Printing Floating-Point Numbers Quickly and Accurately with Integers").
+// The digits always read back as the same double and are the shortest
+// such digits for all but a tiny fraction of values.
+struct DiyFp
+{
+    quint64 f;
+    int e;
+};
+
+struct CachedPower
+{
+    quint64 f;
+    int e;
+    int k;
+};
+
+// normalized 10^k for k = -300, -292, ..., 324
+static const CachedPower CachedPowers[] = {
+    {Q_UINT64_C(0xAB70FE17C79AC6CA), -1060, -300}, {Q_UINT64_C(0xFF77B1FCBEBCDC4F), -1034, -292},
+    {Q_UINT64_C(0xBE5691EF416BD60C), -1007, -284}, {Q_UINT64_C(0x8DD01FAD907FFC3C), -980, -276},
+    {Q_UINT64_C(0xD3515C2831559A83), -954, -268}, {Q_UINT64_C(0x9D71AC8FADA6C9B5), -927, -260},
+    {Q_UINT64_C(0xEA9C227723EE8BCB), -901, -252}, {Q_UINT64_C(0xAECC49914078536D), -874, -244},
+    {Q_UINT64_C(0x823C12795DB6CE57), -847, -236}, {Q_UINT64_C(0xC21094364DFB5637), -821, -228},
+    {Q_UINT64_C(0x9096EA6F3848984F), -794, -220}, {Q_UINT64_C(0xD77485CB25823AC7), -768, -212},
+    {Q_UINT64_C(0xA086CFCD97BF97F4), -741, -204}, {Q_UINT64_C(0xEF340A98172AACE5), -715, -196},
+    {Q_UINT64_C(0xB23867FB2A35B28E), -688, -188}, {Q_UINT64_C(0x84C8D4DFD2C63F3B), -661, -180},
+    {Q_UINT64_C(0xC5DD44271AD3CDBA), -635, -172}, {Q_UINT64_C(0x936B9FCEBB25C996), -608, -164},
+    {Q_UINT64_C(0xDBAC6C247D62A584), -582, -156}, {Q_UINT64_C(0xA3AB66580D5FDAF6), -555, -148},
+    {Q_UINT64_C(0xF3E2F893DEC3F126), -529, -140}, {Q_UINT64_C(0xB5B5ADA8AAFF80B8), -502, -132},
+    {Q_UINT64_C(0x87625F056C7C4A8B), -475, -124}, {Q_UINT64_C(0xC9BCFF6034C13053), -449, -116},
+    {Q_UINT64_C(0x964E858C91BA2655), -422, -108}, {Q_UINT64_C(0xDFF9772470297EBD), -396, -100},
+    {Q_UINT64_C(0xA6DFBD9FB8E5B88F), -369, -92}, {Q_UINT64_C(0xF8A95FCF88747D94), -343, -84},
+    {Q_UINT64_C(0xB94470938FA89BCF), -316, -76}, {Q_UINT64_C(0x8A08F0F8BF0F156B), -289, -68},
+    {Q_UINT64_C(0xCDB02555653131B6), -263, -60}, {Q_UINT64_C(0x993FE2C6D07B7FAC), -236, -52},
+    {Q_UINT64_C(0xE45C10C42A2B3B06), -210, -44}, {Q_UINT64_C(0xAA242499697392D3), -183, -36},
+    {Q_UINT64_C(0xFD87B5F28300CA0E), -157, -28}, {Q_UINT64_C(0xBCE5086492111AEB), -130, -20},
+    {Q_UINT64_C(0x8CBCCC096F5088CC), -103, -12}, {Q_UINT64_C(0xD1B71758E219652C), -77, -4},
+    {Q_UINT64_C(0x9C40000000000000), -50, 4}, {Q_UINT64_C(0xE8D4A51000000000), -24, 12},
+    {Q_UINT64_C(0xAD78EBC5AC620000), 3, 20}, {Q_UINT64_C(0x813F3978F8940984), 30, 28},
+    {Q_UINT64_C(0xC097CE7BC90715B3), 56, 36}, {Q_UINT64_C(0x8F7E32CE7BEA5C70), 83, 44},
+    {Q_UINT64_C(0xD5D238A4ABE98068), 109, 52}, {Q_UINT64_C(0x9F4F2726179A2245), 136, 60},
+    {Q_UINT64_C(0xED63A231D4C4FB27), 162, 68}, {Q_UINT64_C(0xB0DE65388CC8ADA8), 189, 76},
+    {Q_UINT64_C(0x83C7088E1AAB65DB), 216, 84}, {Q_UINT64_C(0xC45D1DF942711D9A), 242, 92},
+    {Q_UINT64_C(0x924D692CA61BE758), 269, 100}, {Q_UINT64_C(0xDA01EE641A708DEA), 295, 108},
+    {Q_UINT64_C(0xA26DA3999AEF774A), 322, 116}, {Q_UINT64_C(0xF209787BB47D6B85), 348, 124},
+    {Q_UINT64_C(0xB454E4A179DD1877), 375, 132}, {Q_UINT64_C(0x865B86925B9BC5C2), 402, 140},
+    {Q_UINT64_C(0xC83553C5C8965D3D), 428, 148}, {Q_UINT64_C(0x952AB45CFA97A0B3), 455, 156},
+    {Q_UINT64_C(0xDE469FBD99A05FE3), 481, 164}, {Q_UINT64_C(0xA59BC234DB398C25), 508, 172},
+    {Q_UINT64_C(0xF6C69A72A3989F5C), 534, 180}, {Q_UINT64_C(0xB7DCBF5354E9BECE), 561, 188},
+    {Q_UINT64_C(0x88FCF317F22241E2), 588, 196}, {Q_UINT64_C(0xCC20CE9BD35C78A5), 614, 204},
+    {Q_UINT64_C(0x98165AF37B2153DF), 641, 212}, {Q_UINT64_C(0xE2A0B5DC971F303A), 667, 220},
+    {Q_UINT64_C(0xA8D9D1535CE3B396), 694, 228}, {Q_UINT64_C(0xFB9B7CD9A4A7443C), 720, 236},
+    {Q_UINT64_C(0xBB764C4CA7A44410), 747, 244}, {Q_UINT64_C(0x8BAB8EEFB6409C1A), 774, 252},
+    {Q_UINT64_C(0xD01FEF10A657842C), 800, 260}, {Q_UINT64_C(0x9B10A4E5E9913129), 827, 268},
+    {Q_UINT64_C(0xE7109BFBA19C0C9D), 853, 276}, {Q_UINT64_C(0xAC2820D9623BF429), 880, 284},
+    {Q_UINT64_C(0x80444B5E7AA7CF85), 907, 292}, {Q_UINT64_C(0xBF21E44003ACDD2D), 933, 300},
+    {Q_UINT64_C(0x8E679C2F5E44FF8F), 960, 308}, {Q_UINT64_C(0xD433179D9C8CB841), 986, 316},
+    {Q_UINT64_C(0x9E19DB92B4E31BA9), 1013, 324},
+};
+
+static DiyFp diyFpMultiply(DiyFp x, DiyFp y)
+{
+    // the upper half of the 128 bit product, rounded
+    const quint64 xLo = x.f & 0xffffffffu;
+    const quint64 xHi = x.f >> 32;
+    const quint64 yLo = y.f & 0xffffffffu;
+    const quint64 yHi = y.f >> 32;
+    const quint64 p0 = xLo * yLo;
+    const quint64 p1 = xLo * yHi;
+    const quint64 p2 = xHi * yLo;
+    const quint64 p3 = xHi * yHi;
+    quint64 middle = (p0 >> 32) + (p1 & 0xffffffffu) + (p2 & 0xffffffffu);
+    middle += quint64(1) << 31;
+    return {p3 + (p1 >> 32) + (p2 >> 32) + (middle >> 32), x.e + y.e + 64};
+}
+
+static DiyFp diyFpNormalize(DiyFp x)
+{
+    const int shift = qCountLeadingZeroBits(x.f);
+    return {x.f << shift, x.e - shift};
+}
+
+// Splits a positive finite double into its digits, returning their count;
+// the value is digits * 10^exponent.
+static int grisu2(double value, char *digits, int *exponent)
+{
+    quint64 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    const quint64 hiddenBit = quint64(1) << 52;
+    const int biasedExponent = int(bits >> 52);
+    const quint64 fraction = bits & (hiddenBit - 1);
+    const DiyFp v = biasedExponent == 0 ? DiyFp{fraction, 1 - 1075} : DiyFp{fraction + hiddenBit, biasedExponent - 1075};
+
+    // the boundaries halfway to the neighbouring doubles
+    const DiyFp plus = diyFpNormalize({2 * v.f + 1, v.e - 1});
+    DiyFp minus = fraction == 0 && biasedExponent > 1 ? DiyFp{4 * v.f - 1, v.e - 2} : DiyFp{2 * v.f - 1, v.e - 1};
+    minus = {minus.f << (minus.e - plus.e), plus.e};
+    const DiyFp w = diyFpNormalize(v);
+
+    // scale by a cached power of ten into the exponent range [-60, -32]
+    const int f = -60 - plus.e - 1;
+    const int k = (f * 78913) / (1 << 18) + (f > 0 ? 1 : 0);
+    const CachedPower &cached = CachedPowers[(300 + k + 7) / 8];
+    const DiyFp c{cached.f, cached.e};
+    const DiyFp scaled = diyFpMultiply(w, c);
+    const DiyFp low = diyFpMultiply(minus, c);
+    const DiyFp high = diyFpMultiply(plus, c);
+    const quint64 upper = high.f - 1;
+    quint64 delta = upper - (low.f + 1);
+    quint64 dist = upper - scaled.f;
+    *exponent = -cached.k;
+
+    const int shift = -high.e;
+    const quint64 one = quint64(1) << shift;
+    quint32 integral = quint32(upper >> shift);
+    quint64 rest = upper & (one - 1);
+
+    quint32 divisor = 1000000000;
+    int remaining = 10;
+    while (remaining > 1 && divisor > integral)
+    {
+        divisor /= 10;
+        --remaining;
+    }
+
+    auto round = [&](int count, quint64 left, quint64 unit) {
+        // move the last digit towards the scaled value while it stays in range
+        while (left < dist && delta - left >= unit && (left + unit < dist || dist - left > left + unit - dist))
+        {
+            --digits[count - 1];
+            left += unit;
+        }
+    };
+
+    int length = 0;
+    while (remaining > 0)
+    {
+        digits[length++] = char('0' + integral / divisor);
+        integral %= divisor;
+        --remaining;
+        const quint64 left = (quint64(integral) << shift) + rest;
+        if (left <= delta)
+        {
+            *exponent += remaining;
+            round(length, left, quint64(divisor) << shift);
+            return length;
+        }
+        divisor /= 10;
+    }
+
+    for (;;)
+    {
+        rest *= 10;
+        delta *= 10;
+        dist *= 10;
+        digits[length++] = char('0' + (rest >> shift));
+        rest &= one - 1;
+        --*exponent;
+        if (rest <= delta)
+        {
+            break;
+        }
+    }
+    round(length, rest, one);
+    return length;
+}
+
+// Writes an integer given by its magnitude and sign.
+static void integerToJson(quint64 magnitude, bool negative, QByteArray &json)
+{
+    char buffer[24];
+    char *out = buffer + sizeof(buffer);
+    do
+    {
+        *--out = char('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+    if (negative)
+    {
+        *--out = '-';
+    }
+    json.append(out, int(buffer + sizeof(buffer) - out));
+}
+
+// Writes a double as the shortest text that reads back as the same value,
+// in exponent notation when that is shorter. Integral values below 2^53
+// skip the digit search.
+void doubleToJson(double d, QByteArray &json)
+{
+    if (!qIsFinite(d))
+    {
+        json += "null"; // +INF || -INF || NaN (see RFC4627#section2.4)
+        return;
+    }
+
+    const bool negative = std::signbit(d);
+    if (negative)
+    {
+        d = -d;
+    }
+    if (d < 9007199254740992.0 && d == double(qint64(d)))
+    {
+        integerToJson(quint64(d), negative, json);
+        return;
+    }
+
+    char buffer[32];
+    char *out = buffer;
+    if (negative)
+    {
+        *out++ = '-';
+    }
+
+    char digits[20];
+    int exponent = 0;
+    const int length = grisu2(d, digits, &exponent);
+
+    // the position of the decimal point relative to the first digit
+    const int point = length + exponent;
+    const int e10 = qAbs(point - 1);
+    const int exponentLength = (point < 1 ? 1 : 0) + (e10 >= 100 ? 3 : e10 >= 10 ? 2 : 1);
+    const int fixedLength = point >= length ? point : point > 0 ? length + 1 : 2 - point + length;
+    const int scientificLength = length + (length > 1 ? 1 : 0) + 1 + exponentLength;
+
+    if (fixedLength <= scientificLength)
+    {
+        if (point >= length)
+        {
+            std::memcpy(out, digits, size_t(length));
+            std::memset(out + length, '0', size_t(point - length));
+            out += point;
+        }
+        else if (point > 0)
+        {
+            std::memcpy(out, digits, size_t(point));
+            out[point] = '.';
+            std::memcpy(out + point + 1, digits + point, size_t(length - point));
+            out += length + 1;
+        }
+        else
+        {
+            *out++ = '0';
+            *out++ = '.';
+            std::memset(out, '0', size_t(-point));
+            out += -point;
+            std::memcpy(out, digits, size_t(length));
+            out += length;
+        }
+    }
+    else
+    {
+        *out++ = digits[0];
+        if (length > 1)
+        {
+            *out++ = '.';
+            std::memcpy(out, digits + 1, size_t(length - 1));
+            out += length - 1;
+        }
+        *out++ = 'e';
+        if (point < 1)
+        {
+            *out++ = '-';
+        }
+        if (e10 >= 100)
+        {
+            *out++ = char('0' + e10 / 100);
+        }
+        if (e10 >= 10)
+        {
+            *out++ = char('0' + e10 / 10 % 10);
+        }
+        *out++ = char('0' + e10 % 10);
+    }
+    json.append(buffer, int(out - buffer));
+}
+
+QJsonModel::QJsonModel(QObject *parent)
+    : QAbstractItemModel(parent)
+    , mArena{new QJsonTreeArena}
+    , mRootItem{mArena->create()}
+    , mMode{Mode::ReadOnly}
+    , mLazyLoading{false}
+    , mFetchBatchSize{256}
+    , mBuildThreads{1}
+    , mParallelThreshold{16 * 1024 * 1024}
+    , mSourceSize{0}
+    , mMappedFile{nullptr}
+    , mSnapshot{nullptr}
+    , mEditSteps{nullptr}
+    , mKeyIndexThreshold{64}
+    , mSearchIndexEnabled{false}
+    , mSearchIndex{nullptr}
+    , mSearch{nullptr}
+{
+   // key indexes hold item pointers: inserted and moved rows outdate the
+   // index of their parent, removed rows may leave any index dangling
+   connect(this, &QAbstractItemModel::rowsInserted, this, [this](const QModelIndex& parent) {
+      mKeyIndex.remove(parent.isValid() ? internalData(parent) : mRootItem);
+      dropSearchIndex();
+   });
+   connect(this, &QAbstractItemModel::rowsMoved, this,
+           [this](const QModelIndex& source, int, int, const QModelIndex& destination) {
+      mKeyIndex.remove(source.isValid() ? internalData(source) : mRootItem);
+      mKeyIndex.remove(destination.isValid() ? internalData(destination) : mRootItem);
+      structureChanged();
+   });
+   connect(this, &QAbstractItemModel::rowsAboutToBeRemoved, this, &QJsonModel::structureChanged);
+   connect(this, &QAbstractItemModel::modelAboutToBeReset, this, &QJsonModel::structureChanged);
+   connect(this, &QAbstractItemModel::modelReset, this, &QJsonModel::structureChanged);
+   connect(this, &QAbstractItemModel::layoutChanged, this, &QJsonModel::structureChanged);
+}
+
+QJsonModel::QJsonModel(const QString& fileName, QObject* parent)
+   : QJsonModel(parent)
+{
+   loadFromFile(fileName);
+}
+
+QJsonModel::QJsonModel(QIODevice* device, QObject* parent)
+   : QJsonModel(parent)
+{
+   if (device) {
+      loadFromDevice(device);
+   }
+}
+
+QJsonModel::QJsonModel(const QByteArray& json, QObject* parent)
+   : QJsonModel(parent)
+{
+   loadFromRaw(json);
+}
+
+QJsonModel::~QJsonModel()
+{
+   delete mSearch;
+   delete mSearchIndex;
+   abandonLoad();
+   delete mArena;
+   delete mMappedFile;
+   delete mSnapshot;
+}
+
+/// Returns the whole of an open \a file mapped into memory, or a null array
+/// when it cannot be mapped.
+static QByteArray mapFile(QFile* file)
+{
+   const qint64 size = file->size();
+   uchar* data = size > 0 && size < std::numeric_limits<int>::max() ? file->map(0, size) : nullptr;
+   return data ? QByteArray::fromRawData(reinterpret_cast<const char*>(data), int(size)) : QByteArray();
+}
+
+/// A member of a container split by a parallel build. Workers build the
+/// members without an item; split containers are created up front.
+struct QJsonBuildJob
+{
+   QJsonTreeItem* parent;
+   QString key;
+   const char* begin;
+   const char* end;
+   int depth;
+   QJsonTreeItem* item;
+};
+
+/// Consecutive build jobs that one worker builds into an arena of its own.
+class QJsonBuildChunk : public QRunnable
+{
+public:
+   QJsonBuildChunk(QJsonBuildJob* jobs, int first, int last, QJsonLoadTask* task)
+      : mJobs(jobs)
+      , mFirst(first)
+      , mLast(last)
+      , mTask(task)
+      , mValid(true)
+   {
+      setAutoDelete(false);
+   }
+
+   void run() override
+   {
+      for (int i = mFirst; i < mLast && mValid; ++i) {
+         if (mTask && mTask->canceled.loadAcquire()) {
+            mValid = false;
+            break;
+         }
+         QJsonBuildJob& job = mJobs[i];
+         if (job.item) {
+            continue;
+         }
+         QJsonReader reader(job.begin, job.end);
+         reader.setArena(&mArena);
+         job.item = mArena.create();
+         mValid = reader.parseItem(job.item, job.depth);
+      }
+   }
+
+   bool isValid() const { return mValid; }
+   QJsonTreeArena& arena() { return mArena; }
+
+private:
+   QJsonBuildJob* mJobs;
+   int mFirst;
+   int mLast;
+   QJsonLoadTask* mTask;
+   bool mValid;
+   QJsonTreeArena mArena;
+};
+
+/// Adds a job for every member of the container \a item was read from.
+/// Containers larger than \a split bytes are split again, so that a single
+/// huge member does not end up on a single worker.
+static bool splitTree(QJsonTreeItem* item, const char* begin, const char* end, int depth, qint64 split,
+                      QJsonTreeArena* arena, QVector<QJsonBuildJob>& jobs, const char** last = nullptr)
+{
+   QVector<QJsonRawMember> members;
+   if (depth >= MaxNestingDepth || !indexRaw(begin, end, members, last)) {
+      return false;
+   }
+
+   const bool object = QJsonValue::Object == item->type();
+   for (const auto& member : members) {
+      QJsonBuildJob job = {item, object ? member.key : QString(), member.begin, member.end, depth + 1, nullptr};
+      const char c = *member.begin;
+      if ((c == '{' || c == '[') && member.end - member.begin > split && depth + 1 < MaxSplitDepth) {
+         job.item = arena->create();
+         job.item->setType(c == '{' ? QJsonValue::Object : QJsonValue::Array);
+         jobs.append(job);
+         if (!splitTree(job.item, member.begin, member.end, depth + 1, split, arena, jobs)) {
+            return false;
+         }
+      }
+      else {
+         jobs.append(job);
+      }
+   }
+   return true;
+}
+
+/// Builds the container in [begin, end) on \a threads workers and returns
+/// its root item in \a arena, or nullptr if the text does not parse.
+static QJsonTreeItem* buildParallel(const char* begin, const char* end, int threads,
+                                    QJsonTreeArena* arena, QJsonLoadTask* task)
+{
+   const qint64 split = qMax<qint64>(1, (end - begin) / (threads * 4));
+   QJsonReader reader(begin, end);
+   reader.skipWhitespace();
+
+   QJsonTreeItem* root = arena->create();
+   root->setType(reader.peek() == '{' ? QJsonValue::Object : QJsonValue::Array);
+   QVector<QJsonBuildJob> jobs;
+   const char* last = nullptr;
+   if (!splitTree(root, reader.pos(), end, 0, split, arena, jobs, &last)) {
+      return nullptr;
+   }
+   QJsonReader rest(last, end);
+   rest.skipWhitespace();
+   if (!rest.atEnd()) {
+      return nullptr;
+   }
+
+   // hand out runs of about split bytes, in document order
+   QVector<QJsonBuildChunk*> chunks;
+   QJsonBuildJob* data = jobs.data();
+   int first = 0;
+   qint64 bytes = 0;
+   for (int i = 0; i < jobs.count(); ++i) {
+      if (!jobs.at(i).item) {
+         bytes += jobs.at(i).end - jobs.at(i).begin;
+      }
+      if (bytes >= split || i + 1 == jobs.count()) {
+         chunks.append(new QJsonBuildChunk(data, first, i + 1, task));
+         first = i + 1;
+         bytes = 0;
+      }
+   }
+
+   QThreadPool pool;
+   pool.setMaxThreadCount(threads);
+   for (auto chunk : chunks) {
+      pool.start(chunk);
+   }
+   pool.waitForDone();
+
+   bool valid = true;
+   for (auto chunk : chunks) {
+      valid = valid && chunk->isValid();
+      arena->merge(chunk->arena());
+   }
+   qDeleteAll(chunks);
+   if (!valid) {
+      return nullptr;
+   }
+
+   // jobs are in document order, so appending gives every item its row
+   for (const auto& job : qAsConst(jobs)) {
+      if (QJsonValue::Object == job.parent->type()) {
+         job.item->setKey(arena->keys().intern(job.key));
+      }
+      job.parent->appendChild(job.item);
+   }
+   return root;
+}
+
+/// Parses \a json into \a arena and returns the root item, or nullptr on
+/// error. In lazy mode the text is only validated and the root is the one
+/// item created. Eager builds use up to \a threads workers.
+static QJsonTreeItem* parseTree(const QByteArray& json, bool lazy, int threads, QJsonTreeArena* arena,
+                                QJsonParseError* error, QJsonLoadTask* task = nullptr)
+{
+   const char* begin = json.constData();
+   const char* end = begin + json.size();
+
+   if (!lazy && threads > 1) {
+      QJsonReader reader(begin, end);
+      reader.skipWhitespace();
+      if (reader.peek() == '{' || reader.peek() == '[') {
+         if (auto root = buildParallel(begin, end, threads, arena, task)) {
+            if (error) {
+               error->error = QJsonParseError::NoError;
+               error->offset = 0;
+            }
+            return root;
+         }
+         if (task && task->canceled.loadAcquire()) {
+            return nullptr;
+         }
+      }
+      // the serial parse reports where the text is broken
+      arena->clear();
+   }
+
+   QJsonReader reader(begin, end);
+   reader.setTask(task);
+   QJsonTreeItem* root = nullptr;
+   bool valid = false;
+
+   reader.skipWhitespace();
+   const char c = reader.peek();
+   if (c != '{' && c != '[') {
+      reader.fail(QJsonParseError::IllegalValue);
+   }
+   else if (lazy) {
+      // validate the whole text up front, but only create the root item;
+      // its children are read from the text when they are fetched
+      valid = reader.skipValue();
+   }
+   else {
+      root = arena->create();
+      reader.setArena(arena);
+      valid = reader.parseItem(root);
+   }
+   if (valid) {
+      reader.skipWhitespace();
+      if (!reader.atEnd()) {
+         valid = reader.fail(QJsonParseError::GarbageAtEnd);
+      }
+   }
+
+   if (error) {
+      error->error = reader.error();
+      error->offset = valid ? 0 : reader.errorOffset();
+   }
+   if (!valid) {
+      if (!reader.canceled()) {
+         qDebug() << Q_FUNC_INFO << "cannot load json at offset" << reader.errorOffset();
+      }
+      return nullptr;
+   }
+
+   return lazy ? QJsonTreeItem::loadLazy(begin, end, nullptr, arena) : root;
+}
+
+/// Runs on a worker thread: reads and parses the source of \a task.
+static bool runLoad(QJsonLoadTask* task)
+{
+   QByteArray json = task->source;
+   if (!task->fileName.isEmpty()) {
+      auto file = new QFile(task->fileName);
+      if (!file->open(QIODevice::ReadOnly)) {
+         qDebug() << Q_FUNC_INFO << "cannot open" << task->fileName;
+         delete file;
+         return false;
+      }
+      json = mapFile(file);
+      if (json.isNull()) {
+         json = file->readAll();
+         delete file;
+      }
+      else {
+         task->file = file;
+      }
+   }
+
+   task->total = json.size();
+   const int threads = task->total >= task->parallelThreshold ? task->threads : 1;
+   task->root = parseTree(json, task->lazy, threads, task->arena, nullptr, task);
+   if (!task->root) {
+      return false;
+   }
+
+   // only lazy items keep reading from the text
+   task->source = task->lazy ? json : QByteArray();
+   json.clear();
+   if (!task->lazy) {
+      delete task->file;
+      task->file = nullptr;
+   }
+   else if (task->file) {
+      task->file->moveToThread(task->thread);
+   }
+
+   return task->report(task->total);
+}
+
+bool QJsonModel::loadFromFile(const QString& fileName, QJsonParseError* error)
+{
+   auto file = new QFile(fileName);
+   bool success = false;
+
+   if (file->open(QIODevice::ReadOnly)) {
+      const QByteArray data = mapFile(file);
+
+      if (!data.isNull()) {
+         // parse straight from the mapping; lazy items keep pointing into it
+         success = loadFromRaw(data, error);
+         if (success && mLazyLoading) {
+            mMappedFile = file;
+            return true;
+         }
+      }
+      else {
+         success = loadFromDevice(file, error);
+      }
+   }
+
+   delete file;
+   return success;
+}
+
+bool QJsonModel::loadFromDevice(QIODevice* device, QJsonParseError* error)
+{
+   return loadFromRaw(device->readAll(), error);
+}
+
+bool QJsonModel::loadFromValue(const QJsonValue& value)
+{
+   if(!value.isObject() && !value.isArray()) {
+      qDebug() << Q_FUNC_INFO << "value must be object or array";
+      return false;
+   }
+
+   beginResetModel();
+   auto arena = new QJsonTreeArena;
+   resetRoot(buildTree(value, arena), arena);
+   mRootItem->setType(value.isObject() ? QJsonValue::Object : QJsonValue::Array);
+   endResetModel();
+
+   return true;
+}
+
+bool QJsonModel::loadFromDocument(const QJsonDocument& document)
+{
+   if(document.isNull()) {
+      qDebug() << Q_FUNC_INFO << "cannot load json";
+      return false;
+   }
+
+   beginResetModel();
+   auto arena = new QJsonTreeArena;
+   if (document.isArray()) {
+      resetRoot(buildTree(QJsonValue(document.array()), arena), arena);
+      mRootItem->setType(QJsonValue::Array);
+
+   } else {
+      resetRoot(buildTree(QJsonValue(document.object()), arena), arena);
+      mRootItem->setType(QJsonValue::Object);
+   }
+   endResetModel();
+   return true;
+}
+
+bool QJsonModel::loadFromRaw(const QByteArray& json, QJsonParseError* error)
+{
+   auto arena = new QJsonTreeArena;
+   QJsonTreeItem* root = parseTree(json, mLazyLoading, buildThreadsFor(json.size()), arena, error);
+   if (!root) {
+      delete arena;
+      return false;
+   }
+
+   beginResetModel();
+   resetRoot(root, arena);
+   if (mLazyLoading) {
+      mSource = json;
+   }
+   mRootItem->setKey("root");
+   mSourceSize = json.size();
+   endResetModel();
+   return true;
+}
+
+bool QJsonModel::reloadFromFile(const QString& fileName, QJsonParseError* error)
+{
+   QFile file(fileName);
+   if (!file.open(QIODevice::ReadOnly)) {
+      qDebug() << Q_FUNC_INFO << "cannot open" << fileName;
+      return false;
+   }
+
+   // the new tree copies what it needs, so the mapping can go right after
+   const QByteArray data = mapFile(&file);
+   return reloadFromRaw(data.isNull() ? file.readAll() : data, error);
+}
+
+bool QJsonModel::reloadFromRaw(const QByteArray& json, QJsonParseError* error)
+{
+   auto arena = new QJsonTreeArena;
+   QJsonTreeItem* root = parseTree(json, false, buildThreadsFor(json.size()), arena, error);
+   if (!root) {
+      delete arena;
+      return false;
+   }
+
+   abandonLoad();
+   mArena->merge(*arena);
+   delete arena;
+
+   if (root->type() != mRootItem->type()) {
+      replaceRoot(root);
+   }
+   else {
+      QHash<const QJsonTreeItem*, quint64> hashes;
+      hashItem(mRootItem, hashes);
+      hashItem(root, hashes);
+      if (!sameItem(mRootItem, root, hashes)) {
+         diffItem(mRootItem, root, hashes);
+      }
+      releaseUnused(root);
+   }
+
+   // every old row has been fetched to be compared, nothing reads the text anymore
+   releaseSource();
+   mSourceSize = json.size();
+   return true;
+}
+
+/// Mixes \a value into \a seed, order dependent.
+static inline quint64 hashCombine(quint64 seed, quint64 value)
+{
+   return seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+}
+
+quint64 QJsonModel::hashItem(QJsonTreeItem* item, QHash<const QJsonTreeItem*, quint64>& hashes)
+{
+   fetchAll(item);
+   quint64 hash = hashCombine(0, quint64(item->type()));
+
+   switch (item->type()) {
+   case QJsonValue::Bool:
+      hash = hashCombine(hash, item->mBool);
+      break;
+   case QJsonValue::Double: {
+      // numbers are the same when they write the same text
+      QByteArray text;
+      item->numberToJson(text);
+      hash = hashCombine(hash, qHash(text));
+      break;
+   }
+   case QJsonValue::String:
+      hash = hashCombine(hash, qHash(item->utf8Value()));
+      break;
+   case QJsonValue::Object:
+   case QJsonValue::Array:
+      for (int row = 0; row < item->childCount(); ++row) {
+         auto child = item->child(row);
+         if (QJsonValue::Object == item->type()) {
+            hash = hashCombine(hash, qHash(child->key()));
+         }
+         hash = hashCombine(hash, hashItem(child, hashes));
+      }
+      break;
+   default:
+      break;
+   }
+   hashes.insert(item, hash);
+   return hash;
+}
+
+bool QJsonModel::sameItem(const QJsonTreeItem* a, const QJsonTreeItem* b,
+                          const QHash<const QJsonTreeItem*, quint64>& hashes) const
+{
+   if (a->type() != b->type()) {
+      return false;
+   }
+
+   switch (a->type()) {
+   case QJsonValue::Bool:
+      return a->mBool == b->mBool;
+   case QJsonValue::Double: {
+      QByteArray textA;
+      QByteArray textB;
+      a->numberToJson(textA);
+      b->numberToJson(textB);
+      return textA == textB;
+   }
+   case QJsonValue::String:
+      return a->utf8Value() == b->utf8Value();
+   case QJsonValue::Object:
+   case QJsonValue::Array:
+      if (a->childCount() != b->childCount() || hashes.value(a) != hashes.value(b)) {
+         return false;
+      }
+      // equal hashes rule out almost everything, but can still collide
+      for (int row = 0; row < a->childCount(); ++row) {
+         const QJsonTreeItem* childA = a->childs().at(row);
+         const QJsonTreeItem* childB = b->childs().at(row);
+         if ((QJsonValue::Object == a->type() && childA->key() != childB->key())
+             || !sameItem(childA, childB, hashes)) {
+            return false;
+         }
+      }
+      return true;
+   default:
+      return true;
+   }
+}
+
+void QJsonModel::diffItem(QJsonTreeItem* item, QJsonTreeItem* target,
+                          const QHash<const QJsonTreeItem*, quint64>& hashes)
+{
+   const auto parentIndex = indexFromItem(item);
+   const QList<QJsonTreeItem*> targets = target->childs();
+   QVector<QJsonTreeItem*> partners(targets.count(), nullptr);
+   QSet<QJsonTreeItem*> kept;
+
+   if (QJsonValue::Object == item->type()) {
+      // members are matched by key
+      QHash<QString, QJsonTreeItem*> members;
+      for (int row = 0; row < item->childCount(); ++row) {
+         members.insert(item->child(row)->key(), item->child(row));
+      }
+      for (int i = 0; i < targets.count(); ++i) {
+         auto member = members.value(targets.at(i)->key());
+         if (member && !kept.contains(member)) {
+            partners[i] = member;
+            kept.insert(member);
+         }
+      }
+   }
+   else {
+      // unchanged elements are matched wherever they moved to, the rest
+      // are paired up in order and compared further
+      QHash<quint64, QList<QJsonTreeItem*>> elements;
+      for (int row = 0; row < item->childCount(); ++row) {
+         auto element = item->child(row);
+         elements[hashes.value(element)].append(element);
+      }
+      for (int i = 0; i < targets.count(); ++i) {
+         auto it = elements.find(hashes.value(targets.at(i)));
+         if (it != elements.end() && !it->isEmpty() && sameItem(it->first(), targets.at(i), hashes)) {
+            partners[i] = it->takeFirst();
+            kept.insert(partners.at(i));
+         }
+      }
+      int row = 0;
+      for (int i = 0; i < targets.count(); ++i) {
+         if (partners.at(i)) {
+            continue;
+         }
+         while (row < item->childCount() && kept.contains(item->child(row))) {
+            ++row;
+         }
+         if (row == item->childCount()) {
+            break;
+         }
+         partners[i] = item->child(row++);
+         kept.insert(partners.at(i));
+      }
+   }
+
+   for (int row = item->childCount() - 1; row >= 0; --row) {
+      if (!kept.contains(item->child(row))) {
+         QJsonTreeItem::destroy(detachItem(item, row), mArena);
+      }
+   }
+
+   for (int i = 0; i < targets.count(); ++i) {
+      auto partner = partners.at(i);
+      if (!partner) {
+         insertItem(item, i, targets.at(i), false);
+         continue;
+      }
+      const int row = partner->row();
+      if (row != i) {
+         beginMoveRows(parentIndex, row, row, parentIndex, i);
+         item->moveChild(row, i);
+         endMoveRows();
+         arrayKeysChanged(parentIndex, i, row);
+      }
+      if (!sameItem(partner, targets.at(i), hashes)) {
+         updateItem(partner, targets.at(i), hashes);
+      }
+   }
+}
+
+void QJsonModel::updateItem(QJsonTreeItem* item, QJsonTreeItem* target,
+                            const QHash<const QJsonTreeItem*, quint64>& hashes)
+{
+   const bool container = QJsonValue::Object == item->type() || QJsonValue::Array == item->type();
+   const bool targetContainer = QJsonValue::Object == target->type() || QJsonValue::Array == target->type();
+
+   if (container && item->type() == target->type()) {
+      diffItem(item, target, hashes);
+   }
+   else if (!container && !targetContainer) {
+      changeValue(item, *target);
+   }
+   else {
+      auto parent = item->parent();
+      const int row = item->row();
+      QJsonTreeItem::destroy(detachItem(parent, row), mArena);
+      insertItem(parent, row, target, false);
+   }
+}
+
+void QJsonModel::releaseUnused(QJsonTreeItem* item)
+{
+   // children that moved into the model have a new parent by now
+   for (auto child : item->childs()) {
+      if (child->mParent == item) {
+         releaseUnused(child);
+      }
+   }
+   if (item->childCount() > 0) {
+      item->mutableChilds().clear();
+   }
+   QJsonTreeItem::destroy(item, mArena);
+}
+
+QFuture<bool> QJsonModel::loadFromFileAsync(const QString& fileName)
+{
+   QSharedPointer<QJsonLoadTask> task(new QJsonLoadTask);
+   task->fileName = fileName;
+   return startLoad(task);
+}
+
+QFuture<bool> QJsonModel::loadFromRawAsync(const QByteArray& json)
+{
+   QSharedPointer<QJsonLoadTask> task(new QJsonLoadTask);
+   task->source = json;
+   return startLoad(task);
+}
+
+void QJsonModel::cancelLoad()
+{
+   if (mLoadTask) {
+      abandonLoad();
+      emit loadFinished(false);
+   }
+}
+
+bool QJsonModel::isLoading() const
+{
+   return !mLoadTask.isNull();
+}
+
+QFuture<bool> QJsonModel::startLoad(const QSharedPointer<QJsonLoadTask>& task)
+{
+   // a newer load makes the pending one stale; it finishes unnoticed
+   abandonLoad();
+   task->model = this;
+   task->thread = thread();
+   task->lazy = mLazyLoading;
+   task->threads = buildThreadsFor(std::numeric_limits<qint64>::max());
+   task->parallelThreshold = mParallelThreshold;
+   mLoadTask = task;
+
+   const QFuture<bool> future = QtConcurrent::run([task]() {
+      return runLoad(task.data());
+   });
+
+   auto watcher = new QFutureWatcher<bool>(this);
+   connect(watcher, &QFutureWatcher<bool>::finished, this, [this, watcher, task]() {
+      finishLoad(task, watcher->result());
+      watcher->deleteLater();
+   });
+   watcher->setFuture(future);
+   return future;
+}
+
+void QJsonModel::finishLoad(const QSharedPointer<QJsonLoadTask>& task, bool success)
+{
+   if (task != mLoadTask) {
+      return;
+   }
+   mLoadTask.clear();
+
+   if (success) {
+      beginResetModel();
+      resetRoot(task->root, task->arena);
+      task->arena = nullptr;
+      mSource = task->source;
+      mMappedFile = task->file;
+      task->file = nullptr;
+      mRootItem->setKey("root");
+      mSourceSize = task->total;
+      endResetModel();
+   }
+   emit loadFinished(success);
+}
+
+void QJsonModel::abandonLoad()
+{
+   if (mLoadTask) {
+      mLoadTask->cancel();
+      mLoadTask.clear();
+   }
+}
+
+void QJsonModel::resetRoot(QJsonTreeItem* root, QJsonTreeArena* arena)
+{
+   // any other tree replaces the one a pending load would deliver
+   abandonLoad();
+
+   // releases the previous tree in O(blocks)
+   delete mArena;
+   releaseSource();
+   mArena = arena;
+   mRootItem = root;
+}
+
+void QJsonModel::releaseSource()
+{
+   mSource.clear();
+   mSourceSize = 0;
+   delete mMappedFile;
+   mMappedFile = nullptr;
+   delete mSnapshot;
+   mSnapshot = nullptr;
+}
+
+QVariant QJsonModel::data(const QModelIndex& index, int role) const
+{
+   if (!index.isValid()){
+      return QVariant();
+   }
+
+   auto item = internalData(index);
+
+   if (role == Qt::DisplayRole) {
+      if (index.column() == 0){
+         return item->key();
+      }
+
+      if (index.column() == 1) {
+         return item->value();
+      }
+
+   } else if (Qt::EditRole == role) {
+      if (index.column() == 1) {
+         return item->value();
+      }
+   }
+
+   return QVariant();
+}
+
+bool QJsonModel::setData(const QModelIndex& index, const QVariant& value, int role)
+{
+   int col = index.column();
+   if (Qt::EditRole == role && index.isValid() && col == 1) {
+      auto item = internalData(index);
+      const bool isContainer = QJsonValue::Object == item->type() || QJsonValue::Array == item->type();
+      if (!isContainer) {
+         QJsonTreeItem source;
+         source.setValue(value);
+         storeValue(item, source);
+         emit dataChanged(index, index, {Qt::EditRole});
+         return true;
+      }
+   }
+
+   return false;
+}
+
+QVariant QJsonModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+   if (role != Qt::DisplayRole){
+      return QVariant();
+   }
+
+   if (orientation == Qt::Horizontal) {
+      static const QStringList headers{{"key", "value"}};
+      return headers.value(section);
+   }
+   else {
+      return QVariant();
+   }
+}
+
+QModelIndex QJsonModel::index(int row, int column, const QModelIndex& parent) const
+{
+   if (!hasIndex(row, column, parent)) {
+      return QModelIndex();
+   }
+
+   QJsonTreeItem* parentItem = parent.isValid() ? internalData(parent) : mRootItem;
+
+   if (auto childItem = parentItem->child(row)) {
+      return createIndex(row, column, childItem);
+   }
+   else {
+      return QModelIndex();
+   }
+}
+
+QModelIndex QJsonModel::parent(const QModelIndex& index) const
 {
    if (!index.isValid()){
       return QModelIndex();
    }
 
-   auto childItem = internalData(index);
-   auto parentItem = childItem->parent();
+   auto childItem = internalData(index);
+   auto parentItem = childItem->parent();
+
+   if (parentItem == mRootItem) {
+      return QModelIndex();
+   }
+
+   return createIndex(parentItem->row(), 0, parentItem);
+}
+
+int QJsonModel::rowCount(const QModelIndex& parent) const
+{
+   QJsonTreeItem* parentItem;
+   if (parent.column() > 0){
+      return 0;
+   }
+
+   if (!parent.isValid()){
+      parentItem = mRootItem;
+   }
+   else {
+      parentItem = internalData(parent);
+   }
+
+   return parentItem->childCount();
+}
+
+int QJsonModel::columnCount(const QModelIndex& /*parent*/) const
+{
+   return 2;
+}
+
+Qt::ItemFlags QJsonModel::flags(const QModelIndex& index) const
+{
+   if(!index.isValid() || mMode == ReadOnly){
+      return QAbstractItemModel::flags(index);
+   }
+
+   int col = index.column();
+   auto item = internalData(index);
+   auto isArray = QJsonValue::Array == item->type();
+   auto isObject = QJsonValue::Object == item->type();
+
+   if ((col == 1) && !(isArray || isObject)) {
+      return Qt::ItemIsEditable | QAbstractItemModel::flags(index);
+   } else {
+      return QAbstractItemModel::flags(index);
+   }
+}
+
+bool QJsonModel::hasChildren(const QModelIndex& parent) const
+{
+   if (parent.column() > 0) {
+      return false;
+   }
+
+   auto parentItem = parent.isValid() ? internalData(parent) : mRootItem;
+   return parentItem->childCount() > 0 || parentItem->canFetchMore();
+}
+
+bool QJsonModel::canFetchMore(const QModelIndex& parent) const
+{
+   if (parent.column() > 0) {
+      return false;
+   }
+
+   auto parentItem = parent.isValid() ? internalData(parent) : mRootItem;
+   return parentItem->canFetchMore();
+}
+
+void QJsonModel::fetchMore(const QModelIndex& parent)
+{
+   if (!canFetchMore(parent)) {
+      return;
+   }
+
+   auto parentItem = parent.isValid() ? internalData(parent) : mRootItem;
+   const int first = parentItem->childCount();
+   const int count = qMin(parentItem->pendingCount(), mFetchBatchSize);
+
+   beginInsertRows(parent, first, first + count - 1);
+   parentItem->fetchMore(count, mArena);
+   endInsertRows();
+}
+
+bool QJsonModel::insertRows(int row, int count, const QModelIndex& parent)
+{
+   auto parentItem = editableParent(parent);
+   if (!parentItem || count <= 0 || row < 0 || row > parentItem->childCount()) {
+      return false;
+   }
+
+   // new rows hold null, object members get a key nothing else uses yet
+   QList<QJsonTreeItem*> items;
+   for (int i = 0; i < count; ++i) {
+      auto item = QJsonTreeItem::create(parentItem, mArena);
+      if (QJsonValue::Object == parentItem->type()) {
+         item->setKey(mArena->keys().intern(uniqueKey(parentItem, QStringLiteral("key"), items)));
+      }
+      items.append(item);
+   }
+
+   beginInsertRows(parent, row, row + count - 1);
+   parentItem->insertChildren(row, items);
+   endInsertRows();
+   arrayKeysChanged(parent, row + count);
+   return true;
+}
+
+bool QJsonModel::removeRows(int row, int count, const QModelIndex& parent)
+{
+   auto parentItem = editableParent(parent);
+   if (!parentItem || count <= 0 || row < 0 || row + count > parentItem->childCount()) {
+      return false;
+   }
+
+   beginRemoveRows(parent, row, row + count - 1);
+   parentItem->removeChildren(row, count, mArena);
+   endRemoveRows();
+   arrayKeysChanged(parent, row);
+   return true;
+}
+
+bool QJsonModel::moveRows(const QModelIndex& sourceParent, int sourceRow, int count,
+                          const QModelIndex& destinationParent, int destinationChild)
+{
+   auto source = editableParent(sourceParent);
+   auto destination = editableParent(destinationParent);
+   if (!source || !destination || count <= 0 || sourceRow < 0 || sourceRow + count > source->childCount()
+       || destinationChild < 0 || destinationChild > destination->childCount()) {
+      return false;
+   }
+   // an item cannot become its own descendant
+   for (auto item = destination; item; item = item->parent()) {
+      if (item->parent() == source && item->row() >= sourceRow && item->row() < sourceRow + count) {
+         return false;
+      }
+   }
+
+   if (!beginMoveRows(sourceParent, sourceRow, sourceRow + count - 1, destinationParent, destinationChild)) {
+      return false;
+   }
+
+   const bool sameParent = source == destination;
+   auto items = source->takeChildren(sourceRow, count);
+   if (!sameParent && QJsonValue::Object == destination->type()) {
+      // array elements and clashing members need a key of their own
+      QList<QJsonTreeItem*> keyed;
+      for (auto item : items) {
+         const QString key = QJsonValue::Object == source->type() ? item->key() : QStringLiteral("key");
+         item->setKey(mArena->keys().intern(uniqueKey(destination, key, keyed)));
+         keyed.append(item);
+      }
+   }
+   const int row = sameParent && destinationChild > sourceRow ? destinationChild - count : destinationChild;
+   destination->insertChildren(row, items);
+   endMoveRows();
+
+   if (sameParent) {
+      arrayKeysChanged(sourceParent, qMin(sourceRow, row), qMax(sourceRow, row) + count - 1);
+   }
+   else {
+      arrayKeysChanged(sourceParent, sourceRow);
+      arrayKeysChanged(destinationParent, row);
+   }
+   return true;
+}
+
+QModelIndex QJsonModel::insertMember(const QModelIndex& parent, int row, const QString& key, const QJsonValue& value)
+{
+   auto parentItem = editableParent(parent);
+   if (!parentItem || QJsonValue::Object != parentItem->type() || row < 0 || row > parentItem->childCount()) {
+      return QModelIndex();
+   }
+   for (int i = 0; i < parentItem->childCount(); ++i) {
+      if (parentItem->child(i)->key() == key) {
+         qDebug() << Q_FUNC_INFO << "key already exists:" << key;
+         return QModelIndex();
+      }
+   }
+
+   auto item = QJsonTreeItem::load(value, parentItem, mArena);
+   item->setType(value.type());
+   item->setKey(mArena->keys().intern(key));
+
+   beginInsertRows(parent, row, row);
+   parentItem->insertChild(row, item);
+   endInsertRows();
+   return index(row, 0, parent);
+}
+
+QModelIndex QJsonModel::insertElement(const QModelIndex& parent, int row, const QJsonValue& value)
+{
+   auto parentItem = editableParent(parent);
+   if (!parentItem || QJsonValue::Array != parentItem->type() || row < 0 || row > parentItem->childCount()) {
+      return QModelIndex();
+   }
+
+   auto item = QJsonTreeItem::load(value, parentItem, mArena);
+   item->setType(value.type());
+
+   beginInsertRows(parent, row, row);
+   parentItem->insertChild(row, item);
+   endInsertRows();
+   arrayKeysChanged(parent, row + 1);
+   return index(row, 0, parent);
+}
+
+QJsonTreeItem* QJsonModel::editableParent(const QModelIndex& parent)
+{
+   if (parent.isValid() && (parent.column() != 0 || parent.model() != this)) {
+      return nullptr;
+   }
+
+   auto item = parent.isValid() ? internalData(parent) : mRootItem;
+   if (QJsonValue::Object != item->type() && QJsonValue::Array != item->type()) {
+      return nullptr;
+   }
+
+   fetchAll(item);
+   return item;
+}
+
+void QJsonModel::fetchAll(QJsonTreeItem* item)
+{
+   // rows are only addressable once all of them exist
+   if (item->canFetchMore()) {
+      const int first = item->childCount();
+      beginInsertRows(indexFromItem(item), first, first + item->pendingCount() - 1);
+      item->fetchMore(item->pendingCount(), mArena);
+      endInsertRows();
+   }
+}
+
+QModelIndex QJsonModel::indexFromItem(QJsonTreeItem* item) const
+{
+   if (!item || item == mRootItem) {
+      return QModelIndex();
+   }
+   return createIndex(item->row(), 0, item);
+}
+
+QString QJsonModel::uniqueKey(QJsonTreeItem* object, const QString& key, const QList<QJsonTreeItem*>& pending)
+{
+   auto taken = [object, &pending](const QString& candidate) {
+      for (int i = 0; i < object->childCount(); ++i) {
+         if (object->child(i)->key() == candidate) {
+            return true;
+         }
+      }
+      for (auto item : pending) {
+         if (item->key() == candidate) {
+            return true;
+         }
+      }
+      return false;
+   };
+
+   QString candidate = key;
+   for (int suffix = 1; taken(candidate); ++suffix) {
+      candidate = key + QString::number(suffix);
+   }
+   return candidate;
+}
+
+void QJsonModel::arrayKeysChanged(const QModelIndex& parent, int first, int last)
+{
+   auto parentItem = parent.isValid() ? internalData(parent) : mRootItem;
+   if (QJsonValue::Array != parentItem->type()) {
+      return;
+   }
+
+   // array keys are row numbers, so shifted rows show a different key
+   last = last < 0 ? parentItem->childCount() - 1 : qMin(last, parentItem->childCount() - 1);
+   if (first <= last) {
+      emit dataChanged(index(first, 0, parent), index(last, 0, parent), {Qt::DisplayRole});
+   }
+}
+
+/// An edit made while a patch is applied, and what it takes to undo it.
+struct QJsonEditStep
+{
+   enum Kind { Inserted, Removed, Changed, Renamed };
+
+   Kind kind;
+   QJsonTreeItem* parent;
+   int row;
+   QJsonTreeItem* item;
+   bool created;
+   // the scalar before a change, stored as it was so exact number text and
+   // 64-bit integers come back unchanged, or the key before a rename
+   QSharedPointer<QJsonTreeItem> saved;
+};
+
+/// Splits a JSON Pointer (RFC 6901) into its unescaped reference tokens.
+static bool splitPointer(const QString& pointer, QStringList* tokens)
+{
+   tokens->clear();
+   if (pointer.isEmpty()) {
+      return true;
+   }
+   if (!pointer.startsWith(QLatin1Char('/'))) {
+      return false;
+   }
+
+   const auto parts = pointer.mid(1).split(QLatin1Char('/'));
+   for (QString token : parts) {
+      for (int i = token.indexOf(QLatin1Char('~')); i >= 0; i = token.indexOf(QLatin1Char('~'), i + 1)) {
+         const QChar next = i + 1 < token.size() ? token.at(i + 1) : QChar();
+         if (next != QLatin1Char('0') && next != QLatin1Char('1')) {
+            return false;
+         }
+         token.replace(i, 2, next == QLatin1Char('0') ? QLatin1Char('~') : QLatin1Char('/'));
+      }
+      tokens->append(token);
+   }
+   return true;
+}
+
+/// Reads an array index token, which has no sign and no leading zeros.
+static int arrayIndex(const QString& token)
+{
+   if (token.isEmpty() || token.size() > 9 || (token.size() > 1 && token.at(0) == QLatin1Char('0'))) {
+      return -1;
+   }
+   for (const QChar c : token) {
+      if (c < QLatin1Char('0') || c > QLatin1Char('9')) {
+         return -1;
+      }
+   }
+   return token.toInt();
+}
+
+/// Removes null members recursively, which is what a merge patch adds.
+static QJsonValue withoutNulls(const QJsonValue& value)
+{
+   if (!value.isObject()) {
+      return value;
+   }
+
+   QJsonObject object;
+   const auto patch = value.toObject();
+   for (auto it = patch.constBegin(); it != patch.constEnd(); ++it) {
+      if (!it.value().isNull()) {
+         object.insert(it.key(), withoutNulls(it.value()));
+      }
+   }
+   return object;
+}
+
+bool QJsonModel::applyPatch(const QByteArray& patch, QString* error)
+{
+   QJsonParseError parseError;
+   const auto document = QJsonDocument::fromJson(patch, &parseError);
+   QString message;
+   bool success = document.isArray();
+   if (!success) {
+      message = parseError.error != QJsonParseError::NoError ? parseError.errorString()
+                                                             : QStringLiteral("patch is not an array");
+   }
+
+   QVector<QJsonEditStep> steps;
+   mEditSteps = &steps;
+   const auto operations = document.array();
+   for (int i = 0; success && i < operations.count(); ++i) {
+      success = applyOperation(operations.at(i).toObject(), &message);
+      if (!success) {
+         message = QStringLiteral("operation %1: %2").arg(i).arg(message);
+      }
+   }
+   mEditSteps = nullptr;
+   finishEdit(steps, success);
+
+   if (!success) {
+      qDebug() << Q_FUNC_INFO << "cannot apply patch:" << message;
+      if (error) {
+         *error = message;
+      }
+   }
+   return success;
+}
+
+bool QJsonModel::applyMergePatch(const QByteArray& patch, QString* error)
+{
+   // QJsonDocument only reads objects and arrays, the patch may be any value
+   QJsonParseError parseError;
+   const auto document = QJsonDocument::fromJson('[' + patch + ']', &parseError);
+   const QJsonValue value = document.array().at(0);
+   QString message;
+   if (parseError.error != QJsonParseError::NoError || document.array().count() != 1) {
+      message = parseError.error != QJsonParseError::NoError ? parseError.errorString()
+                                                             : QStringLiteral("patch is not a single value");
+   }
+   else if (!value.isObject() && !value.isArray()) {
+      message = QStringLiteral("the document can only become an object or an array");
+   }
+
+   if (!message.isEmpty()) {
+      qDebug() << Q_FUNC_INFO << "cannot apply patch:" << message;
+      if (error) {
+         *error = message;
+      }
+      return false;
+   }
+
+   QVector<QJsonEditStep> steps;
+   mEditSteps = &steps;
+   if (value.isObject() && QJsonValue::Object == mRootItem->type()) {
+      mergeItem(mRootItem, value.toObject());
+   }
+   else {
+      replaceRoot(createItem(withoutNulls(value)));
+   }
+   mEditSteps = nullptr;
+   finishEdit(steps, true);
+   return true;
+}
+
+bool QJsonModel::applyOperation(const QJsonObject& operation, QString* error)
+{
+   const QString op = operation.value(QStringLiteral("op")).toString();
+   const QJsonValue value = operation.value(QStringLiteral("value"));
+   QStringList path;
+   QStringList from;
+
+   if (!operation.value(QStringLiteral("path")).isString()
+       || !splitPointer(operation.value(QStringLiteral("path")).toString(), &path)) {
+      *error = QStringLiteral("invalid path");
+      return false;
+   }
+   if ((op == QLatin1String("move") || op == QLatin1String("copy"))
+       && (!operation.value(QStringLiteral("from")).isString()
+           || !splitPointer(operation.value(QStringLiteral("from")).toString(), &from))) {
+      *error = QStringLiteral("invalid from");
+      return false;
+   }
+   if ((op == QLatin1String("add") || op == QLatin1String("replace") || op == QLatin1String("test"))
+       && !operation.contains(QStringLiteral("value"))) {
+      *error = QStringLiteral("missing value");
+      return false;
+   }
+
+   if (op == QLatin1String("add")) {
+      auto item = createItem(value);
+      if (!addItem(path, item, true)) {
+         QJsonTreeItem::destroy(item, mArena);
+         *error = QStringLiteral("cannot add at path");
+         return false;
+      }
+      return true;
+   }
+
+   if (op == QLatin1String("copy")) {
+      auto source = itemAt(from, from.count());
+      if (!source) {
+         *error = QStringLiteral("from does not exist");
+         return false;
+      }
+      auto item = createItem(itemValue(source));
+      if (!addItem(path, item, true)) {
+         QJsonTreeItem::destroy(item, mArena);
+         *error = QStringLiteral("cannot add at path");
+         return false;
+      }
+      return true;
+   }
+
+   if (op == QLatin1String("move")) {
+      auto item = itemAt(from, from.count());
+      if (!item) {
+         *error = QStringLiteral("from does not exist");
+         return false;
+      }
+      if (from == path) {
+         return true;
+      }
+      // a value cannot move into itself
+      if (item == mRootItem || (path.count() > from.count() && path.mid(0, from.count()) == from)) {
+         *error = QStringLiteral("cannot move from");
+         return false;
+      }
+      detachItem(item->parent(), item->row());
+      if (!addItem(path, item, false)) {
+         *error = QStringLiteral("cannot add at path");
+         return false;
+      }
+      return true;
+   }
+
+   auto target = itemAt(path, path.count());
+   if (!target) {
+      *error = QStringLiteral("path does not exist");
+      return false;
+   }
+
+   if (op == QLatin1String("test")) {
+      if (itemValue(target) != value) {
+         *error = QStringLiteral("test failed");
+         return false;
+      }
+      return true;
+   }
+
+   if (op == QLatin1String("remove")) {
+      if (target == mRootItem) {
+         *error = QStringLiteral("cannot remove the document");
+         return false;
+      }
+      detachItem(target->parent(), target->row());
+      return true;
+   }
+
+   if (op == QLatin1String("replace")) {
+      if (target == mRootItem) {
+         if (!value.isObject() && !value.isArray()) {
+            *error = QStringLiteral("the document can only become an object or an array");
+            return false;
+         }
+         replaceRoot(createItem(value));
+      }
+      else {
+         replaceItem(target, value);
+      }
+      return true;
+   }
+
+   *error = QStringLiteral("unknown operation '%1'").arg(op);
+   return false;
+}
+
+bool QJsonModel::addItem(const QStringList& path, QJsonTreeItem* item, bool created)
+{
+   if (path.isEmpty()) {
+      if (QJsonValue::Object != item->type() && QJsonValue::Array != item->type()) {
+         return false;
+      }
+      replaceRoot(item);
+      return true;
+   }
+
+   auto parent = itemAt(path, path.count() - 1);
+   if (!parent) {
+      return false;
+   }
+   fetchAll(parent);
+   const QString& token = path.last();
+
+   if (QJsonValue::Object == parent->type()) {
+      if (mEditSteps && !created) {
+         // a moved item takes the key of its new place
+         QSharedPointer<QJsonTreeItem> saved(new QJsonTreeItem);
+         saved->setKey(item->mKey);
+         mEditSteps->append({QJsonEditStep::Renamed, parent, 0, item, false, saved});
+      }
+      item->setKey(mArena->keys().intern(token));
+      const int row = childRow(parent, token);
+      if (row >= 0) {
+         detachItem(parent, row);
+         insertItem(parent, row, item, created);
+      }
+      else {
+         insertItem(parent, parent->childCount(), item, created);
+      }
+      return true;
+   }
+
+   if (QJsonValue::Array == parent->type()) {
+      const int row = token == QLatin1String("-") ? parent->childCount() : arrayIndex(token);
+      if (row < 0 || row > parent->childCount()) {
+         return false;
+      }
+      insertItem(parent, row, item, created);
+      return true;
+   }
+
+   return false;
+}
+
+void QJsonModel::replaceItem(QJsonTreeItem* item, const QJsonValue& value)
+{
+   const bool scalar = QJsonValue::Object != item->type() && QJsonValue::Array != item->type();
+   if (scalar && !value.isObject() && !value.isArray()) {
+      QJsonTreeItem source;
+      source.setValue(value.toVariant());
+      changeValue(item, source);
+      return;
+   }
+
+   auto parent = item->parent();
+   const int row = item->row();
+   auto replacement = createItem(value);
+   replacement->setKey(item->key());
+   detachItem(parent, row);
+   insertItem(parent, row, replacement, true);
+}
+
+void QJsonModel::replaceRoot(QJsonTreeItem* root)
+{
+   fetchAll(mRootItem);
+   if (mRootItem->childCount() > 0) {
+      beginRemoveRows(QModelIndex(), 0, mRootItem->childCount() - 1);
+      const auto items = mRootItem->takeChildren(0, mRootItem->childCount());
+      endRemoveRows();
+      for (int row = items.count() - 1; row >= 0; --row) {
+         if (mEditSteps) {
+            mEditSteps->append({QJsonEditStep::Removed, mRootItem, row, items.at(row), false, {}});
+         }
+         else {
+            QJsonTreeItem::destroy(items.at(row), mArena);
+         }
+      }
+   }
+
+   if (mEditSteps) {
+      QSharedPointer<QJsonTreeItem> saved(new QJsonTreeItem);
+      saved->copyValue(*mRootItem);
+      mEditSteps->append({QJsonEditStep::Changed, mRootItem, 0, mRootItem, false, saved});
+   }
+   mRootItem->setType(root->type());
+
+   fetchAll(root);
+   const auto items = root->takeChildren(0, root->childCount());
+   QJsonTreeItem::destroy(root, mArena);
+   if (!items.isEmpty()) {
+      beginInsertRows(QModelIndex(), 0, items.count() - 1);
+      mRootItem->insertChildren(0, items);
+      endInsertRows();
+      for (int row = 0; mEditSteps && row < items.count(); ++row) {
+         mEditSteps->append({QJsonEditStep::Inserted, mRootItem, row, items.at(row), true, {}});
+      }
+   }
+}
+
+void QJsonModel::mergeItem(QJsonTreeItem* item, const QJsonObject& patch)
+{
+   fetchAll(item);
+   for (auto it = patch.constBegin(); it != patch.constEnd(); ++it) {
+      const int row = childRow(item, it.key());
+      auto child = row >= 0 ? item->child(row) : nullptr;
+
+      if (it.value().isNull()) {
+         if (child) {
+            detachItem(item, row);
+         }
+      }
+      else if (child && it.value().isObject() && QJsonValue::Object == child->type()) {
+         mergeItem(child, it.value().toObject());
+      }
+      else if (child) {
+         replaceItem(child, withoutNulls(it.value()));
+      }
+      else {
+         auto added = createItem(withoutNulls(it.value()));
+         added->setKey(mArena->keys().intern(it.key()));
+         insertItem(item, item->childCount(), added, true);
+      }
+   }
+}
+
+void QJsonModel::insertItem(QJsonTreeItem* parent, int row, QJsonTreeItem* item, bool created)
+{
+   const auto parentIndex = indexFromItem(parent);
+   beginInsertRows(parentIndex, row, row);
+   parent->insertChild(row, item);
+   endInsertRows();
+   arrayKeysChanged(parentIndex, row + 1);
+
+   if (mEditSteps) {
+      mEditSteps->append({QJsonEditStep::Inserted, parent, row, item, created, {}});
+   }
+}
+
+QJsonTreeItem* QJsonModel::detachItem(QJsonTreeItem* parent, int row)
+{
+   const auto parentIndex = indexFromItem(parent);
+   beginRemoveRows(parentIndex, row, row);
+   auto item = parent->takeChild(row);
+   endRemoveRows();
+   arrayKeysChanged(parentIndex, row);
+
+   if (mEditSteps) {
+      mEditSteps->append({QJsonEditStep::Removed, parent, row, item, false, {}});
+   }
+   return item;
+}
+
+void QJsonModel::changeValue(QJsonTreeItem* item, const QJsonTreeItem& source)
+{
+   if (mEditSteps) {
+      QSharedPointer<QJsonTreeItem> saved(new QJsonTreeItem);
+      saved->copyValue(*item);
+      mEditSteps->append({QJsonEditStep::Changed, item->parent(), item->row(), item, false, saved});
+   }
+   storeValue(item, source);
+   const auto index = createIndex(item->row(), 1, item);
+   emit dataChanged(index, index, {Qt::DisplayRole, Qt::EditRole});
+}
+
+void QJsonModel::finishEdit(const QVector<QJsonEditStep>& steps, bool commit)
+{
+   if (commit) {
+      // removed items are released once nothing can bring them back
+      QSet<QJsonTreeItem*> released;
+      for (const auto& step : steps) {
+         if (QJsonEditStep::Removed == step.kind && !step.item->parent() && !released.contains(step.item)) {
+            released.insert(step.item);
+            QJsonTreeItem::destroy(step.item, mArena);
+         }
+      }
+      return;
+   }
+
+   QVector<QJsonTreeItem*> created;
+   for (int i = steps.count() - 1; i >= 0; --i) {
+      const auto& step = steps.at(i);
+      switch (step.kind) {
+      case QJsonEditStep::Inserted:
+         detachItem(step.parent, step.row);
+         if (step.created) {
+            created.append(step.item);
+         }
+         break;
+      case QJsonEditStep::Removed:
+         insertItem(step.parent, step.row, step.item, false);
+         break;
+      case QJsonEditStep::Changed:
+         if (step.item == mRootItem) {
+            mRootItem->setType(step.saved->type());
+         }
+         else {
+            changeValue(step.item, *step.saved);
+         }
+         break;
+      case QJsonEditStep::Renamed:
+         step.item->setKey(step.saved->mKey);
+         break;
+      }
+   }
+   for (auto item : created) {
+      QJsonTreeItem::destroy(item, mArena);
+   }
+}
+
+QJsonTreeItem* QJsonModel::createItem(const QJsonValue& value)
+{
+   auto item = QJsonTreeItem::load(value, nullptr, mArena);
+   item->setType(value.type());
+   item->setKey(QString());
+   return item;
+}
+
+QJsonTreeItem* QJsonModel::itemAt(const QStringList& path, int depth)
+{
+   auto item = mRootItem;
+   for (int i = 0; item && i < depth; ++i) {
+      fetchAll(item);
+      const int row = QJsonValue::Object == item->type() ? childRow(item, path.at(i))
+                    : QJsonValue::Array == item->type()  ? arrayIndex(path.at(i))
+                                                         : -1;
+      item = row >= 0 ? item->child(row) : nullptr;
+   }
+   return item;
+}
+
+int QJsonModel::childRow(QJsonTreeItem* object, const QString& key) const
+{
+   auto member = memberOf(object, key);
+   return member ? member->row() : -1;
+}
+
+QJsonTreeItem* QJsonModel::memberOf(QJsonTreeItem* object, const QString& key) const
+{
+   const int count = object->childCount();
+   if (count < mKeyIndexThreshold) {
+      for (int row = 0; row < count; ++row) {
+         if (QJsonKeyPool::equal(object->child(row)->key(), key)) {
+            return object->child(row);
+         }
+      }
+      return nullptr;
+   }
+
+   auto index = mKeyIndex.find(object);
+   if (index == mKeyIndex.end()) {
+      index = mKeyIndex.insert(object, QHash<QString, QJsonTreeItem*>());
+      index->reserve(count);
+      // the first of equal keys wins, like the linear search
+      for (int row = count - 1; row >= 0; --row) {
+         index->insert(object->child(row)->key(), object->child(row));
+      }
+   }
+   return index->value(key);
+}
+
+/// Resolves a JSON Pointer (RFC 6901), fetching lazy rows on the way. The
+/// empty pointer refers to the whole document, which has no index either.
+QModelIndex QJsonModel::indexFromPointer(const QString& pointer, int column)
+{
+   QStringList path;
+   if (!splitPointer(pointer, &path)) {
+      return QModelIndex();
+   }
+
+   auto item = itemAt(path, path.count());
+   if (!item || item == mRootItem) {
+      return QModelIndex();
+   }
+   return createIndex(item->row(), column, item);
+}
+
+QString QJsonModel::pointerFromIndex(const QModelIndex& index) const
+{
+   QStringList tokens;
+   for (auto item = index.isValid() ? internalData(index) : mRootItem; item != mRootItem; item = item->parent()) {
+      QString token = item->key();
+      token.replace(QLatin1Char('~'), QLatin1String("~0")).replace(QLatin1Char('/'), QLatin1String("~1"));
+      tokens.prepend(token);
+   }
+   return tokens.isEmpty() ? QString() : QLatin1Char('/') + tokens.join(QLatin1Char('/'));
+}
+
+QJsonValue QJsonModel::itemValue(const QJsonTreeItem* item) const
+{
+   // the writer already knows every kind of item, pending ones included
+   QJsonSaveSink sink;
+   sink.buffer = "[";
+   itemToJson(item, sink, 0, true);
+   sink.buffer += ']';
+   return QJsonDocument::fromJson(sink.buffer).array().at(0);
+}
+
+struct QJsonPathSelector
+{
+   enum Kind { Name, Wildcard, Index, Slice, Filter };
+
+   Kind kind;
+   QString name;
+   int index; // also the start of a slice and the expression of a filter
+   int step;
+   bool hasStart;
+   bool hasEnd;
+   int end;
+};
+
+struct QJsonPathSegment
+{
+   bool descendant;
+   QVector<QJsonPathSelector> selectors;
+};
+
+/// A node of a filter expression. Queries are singular: names and indexes.
+struct QJsonPathExpression
+{
+   enum Op { Or, And, Not, Equal, NotEqual, Less, LessEqual, Greater, GreaterEqual, Matches, Query, Literal };
+
+   Op op;
+   int left;
+   int right;
+   bool absolute;
+   QVector<QJsonPathSelector> steps;
+   QJsonValue literal;
+   QRegularExpression regExp;
+};
+
+struct QJsonPathProgram
+{
+   QVector<QJsonPathSegment> segments;
+   QVector<QJsonPathExpression> expressions;
+};
+
+struct QJsonPathRun
+{
+   const QJsonPathProgram* program;
+   QJsonTreeItem* root;
+   QVector<QJsonTreeItem*> items;
+   int hits;
+};
+
+/// Recursive descent parser for JSONPath expressions.
+class QJsonPathParser
+{
+public:
+   QJsonPathParser(const QString& text, QJsonPathProgram* program)
+      : mText(text)
+      , mPos(0)
+      , mProgram(program)
+   {
+   }
+
+   bool parse()
+   {
+      skipSpaces();
+      if (!take(QLatin1Char('$'))) {
+         return fail(QStringLiteral("a query starts with '$'"));
+      }
+      while (mError.isEmpty() && !atEnd()) {
+         QJsonPathSegment segment;
+         segment.descendant = false;
+         if (take(QLatin1String(".."))) {
+            segment.descendant = true;
+            if (peek() == QLatin1Char('[')) {
+               parseBracket(&segment.selectors);
+            }
+            else {
+               parseDotted(&segment.selectors);
+            }
+         }
+         else if (take(QLatin1Char('.'))) {
+            parseDotted(&segment.selectors);
+         }
+         else if (peek() == QLatin1Char('[')) {
+            parseBracket(&segment.selectors);
+         }
+         else if (peek().isSpace()) {
+            skipSpaces();
+            if (!atEnd()) {
+               fail(QStringLiteral("unexpected space"));
+            }
+            continue;
+         }
+         else {
+            fail(QStringLiteral("unexpected '%1'").arg(peek()));
+         }
+         mProgram->segments.append(segment);
+      }
+      return mError.isEmpty();
+   }
+
+   QString error() const { return mError; }
+
+private:
+   bool atEnd() const { return mPos >= mText.size(); }
+   QChar peek(int ahead = 0) const { return mPos + ahead < mText.size() ? mText.at(mPos + ahead) : QChar(); }
+
+   bool take(QChar c)
+   {
+      if (peek() != c) {
+         return false;
+      }
+      ++mPos;
+      return true;
+   }
+
+   bool take(QLatin1String token)
+   {
+      if (!mText.midRef(mPos).startsWith(token)) {
+         return false;
+      }
+      mPos += token.size();
+      return true;
+   }
+
+   void skipSpaces()
+   {
+      while (peek().isSpace()) {
+         ++mPos;
+      }
+   }
+
+   bool fail(const QString& message)
+   {
+      if (mError.isEmpty()) {
+         mError = QStringLiteral("%1 at %2").arg(message).arg(mPos);
+      }
+      return false;
+   }
+
+   static bool isNameChar(QChar c, bool first)
+   {
+      return c.isLetter() || c == QLatin1Char('_') || c.unicode() >= 0x80
+             || (!first && (c.isDigit() || c == QLatin1Char('-')));
+   }
+
+   bool parseName(QString* name)
+   {
+      const int start = mPos;
+      while (!atEnd() && isNameChar(peek(), mPos == start)) {
+         ++mPos;
+      }
+      *name = mText.mid(start, mPos - start);
+      return !name->isEmpty() || fail(QStringLiteral("expected a member name"));
+   }
+
+   void parseDotted(QVector<QJsonPathSelector>* selectors)
+   {
+      QJsonPathSelector selector{QJsonPathSelector::Wildcard, QString(), 0, 1, false, false, 0};
+      if (!take(QLatin1Char('*'))) {
+         selector.kind = QJsonPathSelector::Name;
+         parseName(&selector.name);
+      }
+      selectors->append(selector);
+   }
+
+   void parseBracket(QVector<QJsonPathSelector>* selectors)
+   {
+      take(QLatin1Char('['));
+      do {
+         skipSpaces();
+         QJsonPathSelector selector{QJsonPathSelector::Wildcard, QString(), 0, 1, false, false, 0};
+         if (peek() == QLatin1Char('\'') || peek() == QLatin1Char('"')) {
+            selector.kind = QJsonPathSelector::Name;
+            parseString(&selector.name);
+         }
+         else if (take(QLatin1Char('?'))) {
+            selector.kind = QJsonPathSelector::Filter;
+            skipSpaces();
+            selector.index = parseOr();
+         }
+         else if (!take(QLatin1Char('*'))) {
+            parseSlice(&selector);
+         }
+         selectors->append(selector);
+         skipSpaces();
+      } while (mError.isEmpty() && take(QLatin1Char(',')));
+
+      if (mError.isEmpty() && !take(QLatin1Char(']'))) {
+         fail(QStringLiteral("expected ']'"));
+      }
+   }
+
+   bool parseInteger(int* value)
+   {
+      const int start = mPos;
+      take(QLatin1Char('-'));
+      while (peek().isDigit()) {
+         ++mPos;
+      }
+      bool ok = false;
+      *value = mText.midRef(start, mPos - start).toInt(&ok);
+      return ok || fail(QStringLiteral("expected an integer"));
+   }
+
+   void parseSlice(QJsonPathSelector* selector)
+   {
+      // [index] or [start:end:step], each part of a slice being optional
+      selector->kind = QJsonPathSelector::Index;
+      if (peek() != QLatin1Char(':')) {
+         selector->hasStart = parseInteger(&selector->index);
+         skipSpaces();
+      }
+      if (!take(QLatin1Char(':'))) {
+         if (!selector->hasStart) {
+            fail(QStringLiteral("expected a selector"));
+         }
+         return;
+      }
+      selector->kind = QJsonPathSelector::Slice;
+      skipSpaces();
+      if (peek() == QLatin1Char('-') || peek().isDigit()) {
+         selector->hasEnd = parseInteger(&selector->end);
+         skipSpaces();
+      }
+      if (take(QLatin1Char(':'))) {
+         skipSpaces();
+         if (peek() == QLatin1Char('-') || peek().isDigit()) {
+            parseInteger(&selector->step);
+         }
+      }
+   }
+
+   bool parseString(QString* value)
+   {
+      const QChar quote = mText.at(mPos++);
+      while (!atEnd() && peek() != quote) {
+         QChar c = mText.at(mPos++);
+         if (c != QLatin1Char('\\')) {
+            value->append(c);
+            continue;
+         }
+         c = peek();
+         ++mPos;
+         switch (c.unicode()) {
+         case 'b': value->append(QLatin1Char('\b')); break;
+         case 'f': value->append(QLatin1Char('\f')); break;
+         case 'n': value->append(QLatin1Char('\n')); break;
+         case 'r': value->append(QLatin1Char('\r')); break;
+         case 't': value->append(QLatin1Char('\t')); break;
+         case 'u': {
+            bool ok = false;
+            const ushort code = mText.midRef(mPos, 4).toUShort(&ok, 16);
+            if (!ok) {
+               return fail(QStringLiteral("invalid escape"));
+            }
+            value->append(QChar(code));
+            mPos += 4;
+            break;
+         }
+         default:
+            value->append(c);
+         }
+      }
+      return take(quote) || fail(QStringLiteral("unterminated string"));
+   }
+
+   int add(const QJsonPathExpression& expression)
+   {
+      mProgram->expressions.append(expression);
+      return mProgram->expressions.count() - 1;
+   }
+
+   int binary(QJsonPathExpression::Op op, int left, int right)
+   {
+      QJsonPathExpression expression;
+      expression.op = op;
+      expression.left = left;
+      expression.right = right;
+      expression.absolute = false;
+      return add(expression);
+   }
+
+   int parseOr()
+   {
+      int left = parseAnd();
+      while (mError.isEmpty()) {
+         skipSpaces();
+         if (!take(QLatin1String("||"))) {
+            break;
+         }
+         left = binary(QJsonPathExpression::Or, left, parseAnd());
+      }
+      return left;
+   }
+
+   int parseAnd()
+   {
+      int left = parseNot();
+      while (mError.isEmpty()) {
+         skipSpaces();
+         if (!take(QLatin1String("&&"))) {
+            break;
+         }
+         left = binary(QJsonPathExpression::And, left, parseNot());
+      }
+      return left;
+   }
+
+   int parseNot()
+   {
+      skipSpaces();
+      if (peek() == QLatin1Char('!') && peek(1) != QLatin1Char('=')) {
+         ++mPos;
+         return binary(QJsonPathExpression::Not, parseNot(), -1);
+      }
+      return parseComparison();
+   }
+
+   int parseComparison()
+   {
+      skipSpaces();
+      if (take(QLatin1Char('('))) {
+         const int inner = parseOr();
+         skipSpaces();
+         if (!take(QLatin1Char(')'))) {
+            fail(QStringLiteral("expected ')'"));
+         }
+         return inner;
+      }
+
+      const int left = parseOperand();
+      skipSpaces();
+      static const struct { const char* token; QJsonPathExpression::Op op; } operators[] = {
+         {"==", QJsonPathExpression::Equal},    {"!=", QJsonPathExpression::NotEqual},
+         {"<=", QJsonPathExpression::LessEqual}, {">=", QJsonPathExpression::GreaterEqual},
+         {"<", QJsonPathExpression::Less},       {">", QJsonPathExpression::Greater},
+         {"=~", QJsonPathExpression::Matches},
+      };
+      for (const auto& candidate : operators) {
+         if (take(QLatin1String(candidate.token))) {
+            skipSpaces();
+            const int right = QJsonPathExpression::Matches == candidate.op ? parseRegExp() : parseOperand();
+            return binary(candidate.op, left, right);
+         }
+      }
+      if (mError.isEmpty() && QJsonPathExpression::Query != mProgram->expressions.at(left).op) {
+         fail(QStringLiteral("expected a comparison"));
+      }
+      return left;
+   }
+
+   int parseOperand()
+   {
+      QJsonPathExpression expression;
+      expression.op = QJsonPathExpression::Literal;
+      expression.left = expression.right = -1;
+      expression.absolute = false;
+
+      if (peek() == QLatin1Char('@') || peek() == QLatin1Char('$')) {
+         expression.op = QJsonPathExpression::Query;
+         expression.absolute = mText.at(mPos++) == QLatin1Char('$');
+         parseSteps(&expression.steps);
+      }
+      else if (peek() == QLatin1Char('\'') || peek() == QLatin1Char('"')) {
+         QString text;
+         parseString(&text);
+         expression.literal = text;
+      }
+      else if (take(QLatin1String("true"))) {
+         expression.literal = true;
+      }
+      else if (take(QLatin1String("false"))) {
+         expression.literal = false;
+      }
+      else if (take(QLatin1String("null"))) {
+         expression.literal = QJsonValue(QJsonValue::Null);
+      }
+      else {
+         const int start = mPos;
+         while (peek().isDigit() || QStringLiteral("+-.eE").contains(peek())) {
+            ++mPos;
+         }
+         bool ok = false;
+         expression.literal = mText.midRef(start, mPos - start).toDouble(&ok);
+         if (!ok) {
+            mPos = start;
+            fail(QStringLiteral("expected a value"));
+         }
+      }
+      return add(expression);
+   }
+
+   void parseSteps(QVector<QJsonPathSelector>* steps)
+   {
+      while (mError.isEmpty()) {
+         QJsonPathSelector step{QJsonPathSelector::Name, QString(), 0, 1, false, false, 0};
+         if (peek() == QLatin1Char('.') && peek(1) != QLatin1Char('.')) {
+            ++mPos;
+            parseName(&step.name);
+         }
+         else if (take(QLatin1Char('['))) {
+            skipSpaces();
+            if (peek() == QLatin1Char('\'') || peek() == QLatin1Char('"')) {
+               parseString(&step.name);
+            }
+            else {
+               step.kind = QJsonPathSelector::Index;
+               parseInteger(&step.index);
+            }
+            skipSpaces();
+            if (!take(QLatin1Char(']'))) {
+               fail(QStringLiteral("filter queries only take a name or an index"));
+            }
+         }
+         else {
+            return;
+         }
+         steps->append(step);
+      }
+   }
+
+   int parseRegExp()
+   {
+      QJsonPathExpression expression;
+      expression.op = QJsonPathExpression::Literal;
+      expression.left = expression.right = -1;
+      expression.absolute = false;
+      if (!take(QLatin1Char('/'))) {
+         fail(QStringLiteral("expected a regular expression"));
+         return add(expression);
+      }
+      QString pattern;
+      while (!atEnd() && peek() != QLatin1Char('/')) {
+         if (peek() == QLatin1Char('\\') && peek(1) == QLatin1Char('/')) {
+            ++mPos;
+         }
+         pattern += mText.at(mPos++);
+      }
+      if (!take(QLatin1Char('/'))) {
+         fail(QStringLiteral("unterminated regular expression"));
+      }
+      expression.regExp.setPattern(pattern);
+      if (take(QLatin1Char('i'))) {
+         expression.regExp.setPatternOptions(QRegularExpression::CaseInsensitiveOption);
+      }
+      if (!expression.regExp.isValid()) {
+         fail(expression.regExp.errorString());
+      }
+      return add(expression);
+   }
+
+   QString mText;
+   int mPos;
+   QJsonPathProgram* mProgram;
+   QString mError;
+};
+
+QJsonPath::QJsonPath()
+{
+}
+
+QJsonPath::QJsonPath(const QString& expression)
+    : mExpression(expression)
+{
+   auto program = new QJsonPathProgram;
+   QJsonPathParser parser(expression, program);
+   if (parser.parse()) {
+      mProgram.reset(program);
+   }
+   else {
+      mError = parser.error();
+      delete program;
+   }
+}
+
+bool QJsonPath::isValid() const
+{
+   return !mProgram.isNull();
+}
+
+QString QJsonPath::expression() const
+{
+   return mExpression;
+}
+
+QString QJsonPath::errorString() const
+{
+   return mError;
+}
+
+/// Runs a query depth first, so the matches come in document order and the
+/// walk stops as soon as \a hits items are found.
+QModelIndexList QJsonModel::query(const QJsonPath& path, int hits)
+{
+   QModelIndexList result;
+   if (!path.isValid()) {
+      qDebug() << Q_FUNC_INFO << path.errorString();
+      return result;
+   }
+
+   QJsonPathRun run{path.mProgram.data(), mRootItem, {}, hits};
+   selectItems(mRootItem, 0, run);
+   for (auto item : qAsConst(run.items)) {
+      // the document itself has no index
+      if (item != mRootItem) {
+         result.append(createIndex(item->row(), 0, item));
+      }
+   }
+   return result;
+}
+
+QJsonArray QJsonModel::queryValues(const QJsonPath& path, int hits)
+{
+   QJsonArray result;
+   if (!path.isValid()) {
+      qDebug() << Q_FUNC_INFO << path.errorString();
+      return result;
+   }
+
+   QJsonPathRun run{path.mProgram.data(), mRootItem, {}, hits};
+   selectItems(mRootItem, 0, run);
+   for (auto item : qAsConst(run.items)) {
+      const bool isContainer = QJsonValue::Object == item->type() || QJsonValue::Array == item->type();
+      result.append(isContainer ? itemValue(item) : QJsonValue::fromVariant(item->value()));
+   }
+   return result;
+}
+
+bool QJsonModel::selectItems(QJsonTreeItem* item, int segment, QJsonPathRun& run)
+{
+   if (segment == run.program->segments.count()) {
+      run.items.append(item);
+      return run.hits < 0 || run.items.count() < run.hits;
+   }
+   return run.program->segments.at(segment).descendant ? selectDescendants(item, segment, run)
+                                                       : applySelectors(item, segment, run);
+}
+
+bool QJsonModel::selectDescendants(QJsonTreeItem* item, int segment, QJsonPathRun& run)
+{
+   if (!applySelectors(item, segment, run)) {
+      return false;
+   }
+   fetchAll(item);
+   for (int row = 0; row < item->childCount(); ++row) {
+      if (!selectDescendants(item->child(row), segment, run)) {
+         return false;
+      }
+   }
+   return true;
+}
+
+bool QJsonModel::applySelectors(QJsonTreeItem* item, int segment, QJsonPathRun& run)
+{
+   const bool isObject = QJsonValue::Object == item->type();
+   const bool isArray = QJsonValue::Array == item->type();
+   if (!isObject && !isArray) {
+      return true;
+   }
+
+   fetchAll(item);
+   const int count = item->childCount();
+   for (const auto& selector : run.program->segments.at(segment).selectors) {
+      switch (selector.kind) {
+      case QJsonPathSelector::Name:
+         if (isObject) {
+            auto member = memberOf(item, selector.name);
+            if (member && !selectItems(member, segment + 1, run)) {
+               return false;
+            }
+         }
+         break;
+      case QJsonPathSelector::Wildcard:
+         for (int row = 0; row < count; ++row) {
+            if (!selectItems(item->child(row), segment + 1, run)) {
+               return false;
+            }
+         }
+         break;
+      case QJsonPathSelector::Index:
+         if (isArray) {
+            const int row = selector.index < 0 ? count + selector.index : selector.index;
+            if (row >= 0 && row < count && !selectItems(item->child(row), segment + 1, run)) {
+               return false;
+            }
+         }
+         break;
+      case QJsonPathSelector::Slice:
+         if (isArray && selector.step != 0) {
+            // bounds are normalized like Python slices
+            auto bound = [count](int value) { return value < 0 ? qMax(count + value, -1) : qMin(value, count); };
+            const int step = selector.step;
+            int first = selector.hasStart ? bound(selector.index) : (step > 0 ? 0 : count - 1);
+            const int last = selector.hasEnd ? bound(selector.end) : (step > 0 ? count : -1);
+            if (step > 0) {
+               first = qMax(first, 0);
+            }
+            else {
+               first = qMin(first, count - 1);
+            }
+            for (int row = first; step > 0 ? row < last : row > last; row += step) {
+               if (!selectItems(item->child(row), segment + 1, run)) {
+                  return false;
+               }
+            }
+         }
+         break;
+      case QJsonPathSelector::Filter:
+         for (int row = 0; row < count; ++row) {
+            if (testFilter(selector.index, item->child(row), run)
+                && !selectItems(item->child(row), segment + 1, run)) {
+               return false;
+            }
+         }
+         break;
+      }
+   }
+   return true;
+}
+
+bool QJsonModel::testFilter(int expression, QJsonTreeItem* current, QJsonPathRun& run)
+{
+   const auto& node = run.program->expressions.at(expression);
+   QJsonValue left;
+   QJsonValue right;
+   bool hasLeft = false;
+   bool hasRight = false;
+
+   switch (node.op) {
+   case QJsonPathExpression::Or:
+      return testFilter(node.left, current, run) || testFilter(node.right, current, run);
+   case QJsonPathExpression::And:
+      return testFilter(node.left, current, run) && testFilter(node.right, current, run);
+   case QJsonPathExpression::Not:
+      return !testFilter(node.left, current, run);
+   case QJsonPathExpression::Query:
+      return filterOperand(expression, current, run, &left);
+   case QJsonPathExpression::Literal:
+      return false;
+   case QJsonPathExpression::Matches:
+      return filterOperand(node.left, current, run, &left) && left.isString()
+             && run.program->expressions.at(node.right).regExp.match(left.toString()).hasMatch();
+   default:
+      break;
+   }
+
+   hasLeft = filterOperand(node.left, current, run, &left);
+   hasRight = filterOperand(node.right, current, run, &right);
+   const bool equal = hasLeft == hasRight && (!hasLeft || left == right);
+   bool less = false;
+   if (hasLeft && hasRight) {
+      if (left.isDouble() && right.isDouble()) {
+         less = left.toDouble() < right.toDouble();
+      }
+      else if (left.isString() && right.isString()) {
+         less = left.toString() < right.toString();
+      }
+      else if (QJsonPathExpression::Equal != node.op && QJsonPathExpression::NotEqual != node.op) {
+         // only numbers and strings are ordered
+         return false;
+      }
+   }
+
+   switch (node.op) {
+   case QJsonPathExpression::Equal:
+      return equal;
+   case QJsonPathExpression::NotEqual:
+      return !equal;
+   case QJsonPathExpression::Less:
+      return less;
+   case QJsonPathExpression::LessEqual:
+      return hasLeft && hasRight && (less || equal);
+   case QJsonPathExpression::Greater:
+      return hasLeft && hasRight && !less && !equal;
+   case QJsonPathExpression::GreaterEqual:
+      return hasLeft && hasRight && !less;
+   default:
+      return false;
+   }
+}
+
+/// Evaluates a literal or a singular query, returning false for a query
+/// that selects nothing.
+bool QJsonModel::filterOperand(int expression, QJsonTreeItem* current, QJsonPathRun& run, QJsonValue* value)
+{
+   const auto& node = run.program->expressions.at(expression);
+   if (QJsonPathExpression::Literal == node.op) {
+      *value = node.literal;
+      return true;
+   }
+
+   QJsonTreeItem* item = node.absolute ? run.root : current;
+   for (const auto& step : node.steps) {
+      const bool isObject = QJsonValue::Object == item->type();
+      const bool isArray = QJsonValue::Array == item->type();
+      if (QJsonPathSelector::Name == step.kind ? !isObject : !isArray) {
+         return false;
+      }
+      fetchAll(item);
+      if (QJsonPathSelector::Name == step.kind) {
+         item = memberOf(item, step.name);
+      }
+      else {
+         const int row = step.index < 0 ? item->childCount() + step.index : step.index;
+         item = row >= 0 && row < item->childCount() ? item->child(row) : nullptr;
+      }
+      if (!item) {
+         return false;
+      }
+   }
+
+   const bool isContainer = QJsonValue::Object == item->type() || QJsonValue::Array == item->type();
+   *value = isContainer ? itemValue(item) : QJsonValue::fromVariant(item->value());
+   return true;
+}
+
+/// Matches text like QAbstractItemModel::match() matches strings.
+class QJsonMatcher
+{
+public:
+   QJsonMatcher(const QString& text, Qt::MatchFlags flags)
+      : mText(text)
+      , mType(flags & 0x0F)
+      , mCase(flags & Qt::MatchCaseSensitive ? Qt::CaseSensitive : Qt::CaseInsensitive)
+   {
+      QString pattern;
+      if (Qt::MatchWildcard == mType) {
+         pattern = QRegularExpression::wildcardToRegularExpression(text);
+      }
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+      else if (Qt::MatchRegularExpression == mType) {
+#else
+      else if (Qt::MatchRegExp == mType) {
+#endif
+         pattern = text;
+      }
+      if (!pattern.isNull()) {
+         mRegExp.setPattern(pattern);
+         mRegExp.setPatternOptions(mCase == Qt::CaseSensitive ? QRegularExpression::NoPatternOption
+                                                             : QRegularExpression::CaseInsensitiveOption);
+      }
+   }
+
+   bool matches(const QString& text) const
+   {
+      switch (mType) {
+      case Qt::MatchContains:
+         return text.contains(mText, mCase);
+      case Qt::MatchStartsWith:
+         return text.startsWith(mText, mCase);
+      case Qt::MatchEndsWith:
+         return text.endsWith(mText, mCase);
+      case Qt::MatchExactly:
+         // as QAbstractItemModel::match(), which ignores the case flag here
+         return text == mText;
+      case Qt::MatchFixedString:
+         return text.compare(mText, mCase) == 0;
+      default:
+         return mRegExp.isValid() && mRegExp.match(text).hasMatch();
+      }
+   }
+
+   /// Plain searches for at least three characters can use trigrams.
+   bool isIndexable() const
+   {
+      return mText.size() >= 3 && mRegExp.pattern().isEmpty();
+   }
+
+   const QString& text() const { return mText; }
+
+private:
+   QString mText;
+   int mType;
+   Qt::CaseSensitivity mCase;
+   QRegularExpression mRegExp;
+};
+
+/// Trigram index over the case folded keys (column 0) and scalar values
+/// (column 1) of the items. A search only checks the items listed for the
+/// rarest trigram of its text.
+struct QJsonSearchIndex
+{
+   static QVector<quint64> trigrams(const QString& text)
+   {
+      const QString folded = text.toCaseFolded();
+      QVector<quint64> result;
+      for (int i = 0; i + 2 < folded.size(); ++i) {
+         result.append(quint64(folded.at(i).unicode()) << 32 | quint64(folded.at(i + 1).unicode()) << 16
+                       | folded.at(i + 2).unicode());
+      }
+      std::sort(result.begin(), result.end());
+      result.erase(std::unique(result.begin(), result.end()), result.end());
+      return result;
+   }
+
+   void add(QJsonTreeItem* item, int column, const QString& text)
+   {
+      for (quint64 trigram : trigrams(text)) {
+         postings[column][trigram].append(item);
+      }
+   }
+
+   void remove(QJsonTreeItem* item, int column, const QString& text)
+   {
+      for (quint64 trigram : trigrams(text)) {
+         auto& items = postings[column][trigram];
+         items.erase(std::remove(items.begin(), items.end(), item), items.end());
+      }
+   }
+
+   QVector<QJsonTreeItem*> candidates(const QString& text, int column) const
+   {
+      QVector<QJsonTreeItem*> rarest;
+      bool first = true;
+      for (quint64 trigram : trigrams(text)) {
+         const auto items = postings[column].value(trigram);
+         if (first || items.size() < rarest.size()) {
+            rarest = items;
+            first = false;
+         }
+         if (rarest.isEmpty()) {
+            break;
+         }
+      }
+      return rarest;
+   }
+
+   QHash<quint64, QVector<QJsonTreeItem*>> postings[2];
+};
+
+/// A running search: a walk over the tree, or over index candidates.
+struct QJsonSearch
+{
+   QJsonSearch(const QString& text, Qt::MatchFlags flags, int column)
+      : matcher(text, flags)
+      , column(column)
+      , indexed(false)
+      , next(0)
+   {
+   }
+
+   QJsonMatcher matcher;
+   int column;
+   bool indexed;
+   QVector<QJsonTreeItem*> candidates;
+   int next;
+   QVector<QPair<QJsonTreeItem*, int>> stack;
+};
+
+/// Sorts \a items into document order, by the rows on their paths from the
+/// root. Postings list items in the order they were indexed.
+static void sortByPosition(QVector<QJsonTreeItem*>& items)
+{
+   QVector<QPair<QVector<int>, QJsonTreeItem*>> paths;
+   paths.reserve(items.size());
+   for (auto item : qAsConst(items)) {
+      QVector<int> rows;
+      for (auto current = item; current->parent(); current = current->parent()) {
+         rows.append(current->row());
+      }
+      std::reverse(rows.begin(), rows.end());
+      paths.append(qMakePair(rows, item));
+   }
+   std::sort(paths.begin(), paths.end(), [](const QPair<QVector<int>, QJsonTreeItem*>& a,
+                                             const QPair<QVector<int>, QJsonTreeItem*>& b) {
+      return a.first < b.first;
+   });
+   for (int i = 0; i < paths.size(); ++i) {
+      items[i] = paths.at(i).second;
+   }
+}
+
+/// The text a search sees: object keys in column 0, scalar values in column 1.
+static bool searchText(const QJsonTreeItem* item, int column, QString* text)
+{
+   if (column == 0) {
+      auto parent = const_cast<QJsonTreeItem*>(item)->parent();
+      if (!parent || QJsonValue::Object != parent->type()) {
+         return false;
+      }
+      *text = item->key();
+      return true;
+   }
+   if (QJsonValue::Object == item->type() || QJsonValue::Array == item->type()) {
+      return false;
+   }
+   *text = item->value().toString();
+   return true;
+}
+
+QModelIndexList QJsonModel::findKeys(const QString& text, Qt::MatchFlags flags, int hits)
+{
+   QJsonSearch search(text, flags, 0);
+   QModelIndexList result;
+   prepareSearch(&search);
+   runSearch(&search, std::numeric_limits<int>::max(), hits, &result);
+   return result;
+}
+
+QModelIndexList QJsonModel::findValues(const QString& text, Qt::MatchFlags flags, int hits)
+{
+   QJsonSearch search(text, flags, 1);
+   QModelIndexList result;
+   prepareSearch(&search);
+   runSearch(&search, std::numeric_limits<int>::max(), hits, &result);
+   return result;
+}
+
+void QJsonModel::startSearch(const QString& text, Qt::MatchFlags flags, int column)
+{
+   cancelSearch();
+   mSearch = new QJsonSearch(text, flags, qBound(0, column, 1));
+   prepareSearch(mSearch);
+   QTimer::singleShot(0, this, &QJsonModel::continueSearch);
+}
+
+void QJsonModel::cancelSearch()
+{
+   if (mSearch) {
+      delete mSearch;
+      mSearch = nullptr;
+      emit searchFinished(false);
+   }
+}
+
+bool QJsonModel::isSearching() const
+{
+   return mSearch != nullptr;
+}
+
+bool QJsonModel::searchIndexEnabled() const
+{
+   return mSearchIndexEnabled;
+}
+
+void QJsonModel::setSearchIndexEnabled(bool enabled)
+{
+   mSearchIndexEnabled = enabled;
+   if (!enabled) {
+      dropSearchIndex();
+   }
+}
+
+void QJsonModel::continueSearch()
+{
+   if (!mSearch) {
+      return;
+   }
+
+   QModelIndexList hits;
+   const bool done = runSearch(mSearch, SearchBatchSize, -1, &hits);
+   if (!hits.isEmpty()) {
+      emit searchHits(hits);
+   }
+   // a slot connected to searchHits() may have canceled or restarted it
+   if (!done || !mSearch) {
+      if (mSearch) {
+         QTimer::singleShot(0, this, &QJsonModel::continueSearch);
+      }
+      return;
+   }
+   delete mSearch;
+   mSearch = nullptr;
+   emit searchFinished(true);
+}
+
+void QJsonModel::prepareSearch(QJsonSearch* search)
+{
+   if (mSearchIndexEnabled && search->matcher.isIndexable()) {
+      buildSearchIndex();
+      search->indexed = true;
+      search->candidates = mSearchIndex->candidates(search->matcher.text(), search->column);
+      sortByPosition(search->candidates);
+   }
+   else {
+      search->stack.append(qMakePair(mRootItem, 0));
+   }
+}
+
+bool QJsonModel::runSearch(QJsonSearch* search, int budget, int hits, QModelIndexList* result)
+{
+   QString text;
+   auto visit = [&](QJsonTreeItem* item) {
+      if (searchText(item, search->column, &text) && search->matcher.matches(text)) {
+         result->append(createIndex(item->row(), search->column, item));
+      }
+   };
+   auto full = [&]() { return hits >= 0 && result->count() >= hits; };
 
-   if (parentItem == mRootItem) {
-      return QModelIndex();
+   if (search->indexed) {
+      for (; search->next < search->candidates.count() && budget > 0 && !full(); --budget) {
+         visit(search->candidates.at(search->next++));
+      }
+      return search->next == search->candidates.count() || full();
    }
 
-   return createIndex(parentItem->row(), 0, parentItem);
+   // depth first, so hits come in document order
+   while (!search->stack.isEmpty() && budget > 0 && !full()) {
+      auto& top = search->stack.last();
+      QJsonTreeItem* item = top.first;
+      if (top.second == 0) {
+         fetchAll(item);
+      }
+      if (top.second >= item->childCount()) {
+         search->stack.removeLast();
+         continue;
+      }
+      QJsonTreeItem* child = item->child(top.second++);
+      visit(child);
+      --budget;
+      if (child->childCount() > 0 || child->canFetchMore()) {
+         search->stack.append(qMakePair(child, 0));
+      }
+   }
+   return search->stack.isEmpty() || full();
 }
 
-int QJsonModel::rowCount(const QModelIndex& parent) const
+void QJsonModel::buildSearchIndex()
 {
-   QJsonTreeItem* parentItem;
-   if (parent.column() > 0){
-      return 0;
+   if (mSearchIndex) {
+      return;
    }
 
-   if (!parent.isValid()){
-      parentItem = mRootItem;
+   // fetching inserts rows, which would drop an index under construction
+   QVector<QJsonTreeItem*> items;
+   items.append(mRootItem);
+   for (int i = 0; i < items.count(); ++i) {
+      fetchAll(items.at(i));
+      for (int row = 0; row < items.at(i)->childCount(); ++row) {
+         items.append(items.at(i)->child(row));
+      }
    }
-   else {
-      parentItem = internalData(parent);
+
+   mSearchIndex = new QJsonSearchIndex;
+   QString text;
+   for (auto item : qAsConst(items)) {
+      for (int column = 0; column < 2; ++column) {
+         if (searchText(item, column, &text)) {
+            mSearchIndex->add(item, column, text);
+         }
+      }
    }
+}
 
-   return parentItem->childCount();
+void QJsonModel::dropSearchIndex()
+{
+   delete mSearchIndex;
+   mSearchIndex = nullptr;
 }
 
-int QJsonModel::columnCount(const QModelIndex& /*parent*/) const
+void QJsonModel::structureChanged()
 {
-   return 2;
+   mKeyIndex.clear();
+   dropSearchIndex();
+   // the running search may point at items that are about to go
+   cancelSearch();
 }
 
-Qt::ItemFlags QJsonModel::flags(const QModelIndex& index) const
+void QJsonModel::storeValue(QJsonTreeItem* item, const QJsonTreeItem& source)
 {
-   if(!index.isValid() || mMode == ReadOnly){
-      return QAbstractItemModel::flags(index);
+   QString text;
+   if (mSearchIndex && searchText(item, 1, &text)) {
+      mSearchIndex->remove(item, 1, text);
    }
-
-   int col = index.column();
-   auto item = internalData(index);
-   auto isArray = QJsonValue::Array == item->type();
-   auto isObject = QJsonValue::Object == item->type();
-
-   if ((col == 1) && !(isArray || isObject)) {
-      return Qt::ItemIsEditable | QAbstractItemModel::flags(index);
-   } else {
-      return QAbstractItemModel::flags(index);
+   item->copyValue(source);
+   if (mSearchIndex && searchText(item, 1, &text)) {
+      mSearchIndex->add(item, 1, text);
    }
 }
 
 QByteArray QJsonModel::json(bool compact) const
 {
-    auto jsonValue = genJson(mRootItem);
-    QByteArray json;
-    if (jsonValue.isNull()) {
-        return json;
+    QJsonSaveSink sink;
+    const auto type = mRootItem->type();
+    if (QJsonValue::Object != type && QJsonValue::Array != type) {
+        return sink.buffer;
+    }
+    // the loaded text is a good lower bound; indentation roughly doubles it
+    sink.buffer.reserve(int(qMin<qint64>(mSourceSize * (compact ? 1 : 2), 1 << 30)));
+    itemToJson(mRootItem, sink, 0, compact);
+    if (!compact)
+        sink.buffer += '\n';
+    return sink.buffer;
+}
+
+bool QJsonModel::saveToDevice(QIODevice* device, bool compact) const
+{
+    if (!device || !device->isWritable()) {
+        qDebug() << Q_FUNC_INFO << "device is not writable";
+        return false;
+    }
+    const auto type = mRootItem->type();
+    if (QJsonValue::Object != type && QJsonValue::Array != type) {
+        return true;
+    }
+
+    QJsonSaveSink sink(device);
+    itemToJson(mRootItem, sink, 0, compact);
+    if (!compact)
+        sink.buffer += '\n';
+    return sink.finish();
+}
+
+bool QJsonModel::saveToFile(const QString& fileName, bool compact, bool atomic) const
+{
+    if (atomic) {
+        QSaveFile file(fileName);
+        if (!file.open(QIODevice::WriteOnly)) {
+            return false;
+        }
+        if (!saveToDevice(&file, compact)) {
+            file.cancelWriting();
+            return false;
+        }
+        return file.commit();
+    }
+
+    QFile file(fileName);
+    bool success = false;
+
+    if (file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        success = saveToDevice(&file, compact);
+        file.close();
+    }
+
+    return success;
+}
+
+/// Loads a snapshot written by saveSnapshot(). The file is mapped when it
+/// can be, and items decode their children from it only when fetched.
+bool QJsonModel::loadSnapshot(const QString& fileName)
+{
+    auto file = new QFile(fileName);
+    bool success = false;
+
+    if (file->open(QIODevice::ReadOnly)) {
+        const QByteArray data = mapFile(file);
+        success = loadSnapshotData(data.isNull() ? file->readAll() : data);
+        if (success && !data.isNull()) {
+            mMappedFile = file;
+            return true;
+        }
+    }
+    else {
+        qDebug() << Q_FUNC_INFO << "cannot open" << fileName;
+    }
+
+    delete file;
+    return success;
+}
+
+bool QJsonModel::loadSnapshot(QIODevice* device)
+{
+    return loadSnapshotData(device->readAll());
+}
+
+/// Writes the tree as a binary snapshot for loadSnapshot(), including the
+/// children lazy items have not fetched yet.
+bool QJsonModel::saveSnapshot(QIODevice* device) const
+{
+    if (!device || !device->isWritable()) {
+        qDebug() << Q_FUNC_INFO << "device is not writable";
+        return false;
+    }
+    QJsonSnapshotWriter writer(device);
+    return writer.write(mRootItem);
+}
+
+bool QJsonModel::loadSnapshotData(const QByteArray& data)
+{
+    auto snapshot = new QJsonSnapshot;
+    if (!snapshot->open(data)) {
+        qDebug() << Q_FUNC_INFO << "not a snapshot of this version";
+        delete snapshot;
+        return false;
+    }
+    if (!snapshot->validate()) {
+        qDebug() << Q_FUNC_INFO << "corrupt snapshot";
+        delete snapshot;
+        return false;
+    }
+
+    // items take their keys from the table, already shared with the pool
+    auto arena = new QJsonTreeArena;
+    for (auto& key : snapshot->keys) {
+        key = arena->keys().intern(key);
+    }
+    QJsonTreeItem* root = QJsonTreeItem::loadSlot(snapshot, snapshot->root, nullptr, arena);
+
+    beginResetModel();
+    resetRoot(root, arena);
+    mSource = data;
+    mSnapshot = snapshot;
+    mRootItem->setKey("root");
+    mSourceSize = data.size();
+    endResetModel();
+    return true;
+}
+
+/// Builds the tree straight from CBOR, which must hold a single item.
+bool QJsonModel::loadFromCbor(const QByteArray& cbor)
+{
+    QCborStreamReader reader(cbor);
+    return loadCbor(reader, cbor.size());
+}
+
+/// Reads CBOR from \a device as it builds the tree, without reading it
+/// into memory first.
+bool QJsonModel::loadFromCbor(QIODevice* device)
+{
+    QCborStreamReader reader(device);
+    return loadCbor(reader, device->size());
+}
+
+QByteArray QJsonModel::toCbor() const
+{
+    QJsonSaveSink sink;
+    QCborStreamWriter writer(&sink.buffer);
+    itemToCbor(mRootItem, writer, sink);
+    return sink.buffer;
+}
+
+bool QJsonModel::saveCbor(QIODevice* device) const
+{
+    if (!device || !device->isWritable()) {
+        qDebug() << Q_FUNC_INFO << "device is not writable";
+        return false;
+    }
+
+    // encoded into the sink, so write errors are caught as by saveToDevice()
+    QJsonSaveSink sink(device);
+    QJsonSaveSinkDevice encoded(sink);
+    QCborStreamWriter writer(&encoded);
+    itemToCbor(mRootItem, writer, sink);
+    return sink.finish();
+}
+
+bool QJsonModel::loadCbor(QCborStreamReader& reader, qint64 size)
+{
+    auto arena = new QJsonTreeArena;
+    QJsonTreeItem* root = arena->create();
+    QJsonCborReader cbor(reader, arena);
+    // anything left after the item, such as a second one, is an error
+    if (!cbor.readItem(root) || reader.lastError() != QCborError::NoError || reader.isValid()) {
+        qDebug() << Q_FUNC_INFO << "cannot read cbor:" << reader.lastError().toString()
+                 << "at" << reader.currentOffset();
+        delete arena;
+        return false;
+    }
+
+    beginResetModel();
+    resetRoot(root, arena);
+    mRootItem->setKey("root");
+    mSourceSize = size;
+    endResetModel();
+    return true;
+}
+
+/// Builds the tree straight from MessagePack, which must hold a single item.
+bool QJsonModel::loadFromMsgPack(const QByteArray& msgpack)
+{
+    auto arena = new QJsonTreeArena;
+    QJsonTreeItem* root = arena->create();
+    QJsonMsgPackReader reader(msgpack.constData(), msgpack.constData() + msgpack.size(), arena);
+    if (!reader.readItem(root) || !reader.atEnd()) {
+        qDebug() << Q_FUNC_INFO << "cannot read msgpack at" << reader.offset(msgpack.constData());
+        delete arena;
+        return false;
+    }
+
+    beginResetModel();
+    resetRoot(root, arena);
+    mRootItem->setKey("root");
+    mSourceSize = msgpack.size();
+    endResetModel();
+    return true;
+}
+
+bool QJsonModel::loadFromMsgPack(QIODevice* device)
+{
+    return loadFromMsgPack(device->readAll());
+}
+
+QByteArray QJsonModel::toMsgPack() const
+{
+    QJsonSaveSink sink;
+    itemToMsgPack(mRootItem, sink);
+    return sink.buffer;
+}
+
+bool QJsonModel::saveMsgPack(QIODevice* device) const
+{
+    if (!device || !device->isWritable()) {
+        qDebug() << Q_FUNC_INFO << "device is not writable";
+        return false;
+    }
+
+    // handed to the device every SaveChunkSize bytes, as by saveToDevice()
+    QJsonSaveSink sink(device);
+    itemToMsgPack(mRootItem, sink);
+    return sink.finish();
+}
+
+void QJsonModel::itemToJson(const QJsonTreeItem* item, QJsonSaveSink &sink, int indent, bool compact) const
+{
+    QByteArray &json = sink.buffer;
+    switch (item->type())
+    {
+    case QJsonValue::Array:
+        json += compact ? "[" : "[\n";
+        itemContentToJson(item, sink, indent + (compact ? 0 : 1), compact);
+        json += QByteArray(4 * indent, ' ');
+        json += ']';
+        break;
+    case QJsonValue::Object:
+        json += compact ? "{" : "{\n";
+        itemContentToJson(item, sink, indent + (compact ? 0 : 1), compact);
+        json += QByteArray(4 * indent, ' ');
+        json += '}';
+        break;
+    case QJsonValue::Bool:
+        json += item->mBool ? "true" : "false";
+        break;
+    case QJsonValue::Double:
+        item->numberToJson(json);
+        break;
+    case QJsonValue::String:
+        json += '"';
+        if (QJsonTreeItem::Utf8 == item->mStorage)
+        {
+            // kept only if the bytes are exactly what escaping would write
+            json += item->mUtf8;
+        }
+        else
+        {
+            appendEscapedString(item->mString, json);
+        }
+        json += '"';
+        break;
+    default:
+        json += "null";
+    }
+}
+
+void QJsonModel::itemContentToJson(const QJsonTreeItem* item, QJsonSaveSink &sink, int indent, bool compact) const
+{
+    QByteArray &json = sink.buffer;
+    const int count = item->childCount();
+    const int total = count + item->pendingCount();
+    if (total <= 0)
+    {
+        return;
+    }
+    const bool isObject = QJsonValue::Object == item->type();
+    QByteArray indentString(4 * indent, ' ');
+    int i = 0;
+    auto writeSeparator = [&]()
+    {
+        if (++i == total)
+        {
+            if (!compact)
+                json += '\n';
+        }
+        else
+        {
+            json += compact ? "," : ",\n";
+        }
+        sink.flush();
+    };
+    auto writeKey = [&](const QString& key)
+    {
+        json += '"';
+        appendEscapedString(key, json);
+        json += compact ? "\":" : "\": ";
+    };
+
+    for (const QJsonTreeItem* child : item->childs())
+    {
+        json += indentString;
+        if (isObject)
+            writeKey(child->key());
+        itemToJson(child, sink, indent, compact);
+        writeSeparator();
+    }
+
+    // children a lazy item has not fetched yet are written from its source value
+    QJsonTreeItem::Pending* pending = item->pending();
+    if (!pending)
+    {
+        return;
+    }
+    if (pending->isSnapshot())
+    {
+        for (int index = pending->next; index < pending->count; ++index)
+        {
+            QScopedPointer<QJsonTreeItem> child(item->loadPending(index, nullptr, nullptr));
+            json += indentString;
+            if (isObject)
+                writeKey(child->key());
+            itemToJson(child.data(), sink, indent, compact);
+            writeSeparator();
+        }
+    }
+    else if (pending->isRaw())
+    {
+        const auto& members = pending->members;
+        for (int index = pending->next; index < members.size(); ++index)
+        {
+            json += indentString;
+            if (isObject)
+                writeKey(members.at(index).key);
+            rawToJson(members.at(index).begin, members.at(index).end, sink, indent, compact);
+            writeSeparator();
+        }
+    }
+    else if (isObject)
+    {
+        const auto object = pending->value.toObject();
+        for (auto it = object.constBegin() + pending->next; it != object.constEnd(); ++it)
+        {
+            json += indentString;
+            writeKey(it.key());
+            valueToJson(it.value(), sink, indent, compact);
+            writeSeparator();
+        }
+    }
+    else
+    {
+        const auto array = pending->value.toArray();
+        for (int index = pending->next; index < array.size(); ++index)
+        {
+            json += indentString;
+            valueToJson(array.at(index), sink, indent, compact);
+            writeSeparator();
+        }
+    }
+}
+
+// Numbers kept as text are integers past 64 bits or decimals past double
+// precision. CBOR holds negative integers down to -2^64, anything else is
+// written as the nearest double.
+void QJsonModel::itemToCbor(const QJsonTreeItem *item, QCborStreamWriter &writer, QJsonSaveSink &sink) const
+{
+    switch (item->type())
+    {
+    case QJsonValue::Array:
+    case QJsonValue::Object:
+    {
+        const bool isObject = QJsonValue::Object == item->type();
+        const quint64 count = quint64(item->childCount() + item->pendingCount());
+        if (isObject)
+            writer.startMap(count);
+        else
+            writer.startArray(count);
+        item->forEachChild([&](const QJsonTreeItem *child)
+        {
+            if (isObject)
+                writer.append(child->key());
+            itemToCbor(child, writer, sink);
+            sink.flush();
+        });
+        if (isObject)
+            writer.endMap();
+        else
+            writer.endArray();
+        break;
+    }
+    case QJsonValue::Bool:
+        writer.append(item->mBool);
+        break;
+    case QJsonValue::Double:
+        if (QJsonTreeItem::Integer == item->mStorage)
+        {
+            writer.append(item->mInteger);
+        }
+        else if (QJsonTreeItem::Unsigned == item->mStorage)
+        {
+            writer.append(item->mUnsigned);
+        }
+        else if (QJsonTreeItem::Utf8 == item->mStorage)
+        {
+            const QByteArray &text = item->mUtf8;
+            const quint64 max = std::numeric_limits<quint64>::max();
+            bool negativeInteger = text.size() > 1 && text.at(0) == '-';
+            quint64 magnitude = 0;
+            for (int i = 1; negativeInteger && i < text.size(); ++i)
+            {
+                const quint64 digit = quint64(text.at(i) - '0');
+                negativeInteger = isDigit(text.at(i)) && magnitude <= (max - digit) / 10;
+                magnitude = magnitude * 10 + digit;
+            }
+            // -2^64 is stored as a magnitude of 0
+            if (negativeInteger && magnitude != 0)
+                writer.append(QCborNegativeInteger(magnitude));
+            else if (text == "-18446744073709551616")
+                writer.append(QCborNegativeInteger(0));
+            else
+                writer.append(item->value().toDouble());
+        }
+        else
+        {
+            writer.append(item->mDouble);
+        }
+        break;
+    case QJsonValue::String:
+        if (QJsonTreeItem::Utf8 == item->mStorage)
+            writer.appendTextString(item->mUtf8.constData(), item->mUtf8.size());
+        else
+            writer.append(item->mString);
+        break;
+    default:
+        writer.appendNull();
+    }
+}
+
+// Writes big endian MessagePack, in the smallest form that holds each value.
+// Numbers kept as text are written as the nearest double.
+void QJsonModel::itemToMsgPack(const QJsonTreeItem *item, QJsonSaveSink &sink) const
+{
+    QByteArray &msgpack = sink.buffer;
+    auto appendNumber = [&](uchar marker, quint64 value, int size)
+    {
+        char bytes[9];
+        bytes[0] = char(marker);
+        for (int i = size; i > 0; --i)
+        {
+            bytes[i] = char(value & 0xff);
+            value >>= 8;
+        }
+        msgpack.append(bytes, size + 1);
+    };
+    // fix forms for small sizes, else the 16 or 32 bit form after them
+    auto appendHeader = [&](uchar fix, int fixLimit, uchar marker8, quint64 size)
+    {
+        if (size < quint64(fixLimit))
+            msgpack += char(fix | size);
+        else if (marker8 && size <= 0xff)
+            appendNumber(marker8, size, 1);
+        else if (size <= 0xffff)
+            appendNumber(marker8 ? marker8 + 1 : fix == 0x80 ? 0xde : 0xdc, size, 2);
+        else
+            appendNumber(marker8 ? marker8 + 2 : fix == 0x80 ? 0xdf : 0xdd, size, 4);
+    };
+    auto appendDouble = [&](double d)
+    {
+        quint64 bits;
+        std::memcpy(&bits, &d, sizeof(bits));
+        appendNumber(0xcb, bits, 8);
+    };
+
+    switch (item->type())
+    {
+    case QJsonValue::Array:
+    case QJsonValue::Object:
+    {
+        const bool isObject = QJsonValue::Object == item->type();
+        appendHeader(isObject ? 0x80 : 0x90, 16, 0, quint64(item->childCount() + item->pendingCount()));
+        item->forEachChild([&](const QJsonTreeItem *child)
+        {
+            if (isObject)
+            {
+                const QByteArray key = child->key().toUtf8();
+                appendHeader(0xa0, 32, 0xd9, quint64(key.size()));
+                msgpack += key;
+            }
+            itemToMsgPack(child, sink);
+            sink.flush();
+        });
+        break;
     }
-    if (jsonValue.isArray()) {
-        arrayToJson(jsonValue.toArray(), json, 0, compact);
+    case QJsonValue::Bool:
+        msgpack += char(item->mBool ? 0xc3 : 0xc2);
+        break;
+    case QJsonValue::Double:
+        if (QJsonTreeItem::Integer == item->mStorage && item->mInteger >= 0)
+        {
+            const quint64 value = quint64(item->mInteger);
+            if (value <= 0x7f)
+                msgpack += char(value);
+            else if (value <= 0xff)
+                appendNumber(0xcc, value, 1);
+            else if (value <= 0xffff)
+                appendNumber(0xcd, value, 2);
+            else if (value <= 0xffffffff)
+                appendNumber(0xce, value, 4);
+            else
+                appendNumber(0xcf, value, 8);
+        }
+        else if (QJsonTreeItem::Integer == item->mStorage)
+        {
+            const qint64 value = item->mInteger;
+            if (value >= -32)
+                msgpack += char(value);
+            else if (value >= -128)
+                appendNumber(0xd0, quint64(value), 1);
+            else if (value >= -32768)
+                appendNumber(0xd1, quint64(value), 2);
+            else if (value >= -2147483648LL)
+                appendNumber(0xd2, quint64(value), 4);
+            else
+                appendNumber(0xd3, quint64(value), 8);
+        }
+        else if (QJsonTreeItem::Unsigned == item->mStorage)
+        {
+            appendNumber(0xcf, item->mUnsigned, 8);
+        }
+        else
+        {
+            appendDouble(item->value().toDouble());
+        }
+        break;
+    case QJsonValue::String:
+    {
+        const QByteArray utf8 = item->utf8Value();
+        appendHeader(0xa0, 32, 0xd9, quint64(utf8.size()));
+        msgpack += utf8;
+        break;
     }
-    else {
-        objectToJson(jsonValue.toObject(), json, 0, compact);
+    default:
+        msgpack += char(0xc0);
     }
-    return json;
 }
 
-void QJsonModel::objectToJson(QJsonObject jsonObject, QByteArray &json, int indent, bool compact) const
+void QJsonModel::rawToJson(const char *begin, const char *end, QJsonSaveSink &sink, int indent, bool compact) const
 {
-    json += compact ? "{" : "{\n";
-    objectContentToJson(jsonObject, json, indent + (compact ? 0 : 1), compact);
-    json += QByteArray(4 * indent, ' ');
-    json += compact ? "}" : "}\n";
-}
+    QByteArray &json = sink.buffer;
+    QJsonReader reader(begin, end);
+    reader.skipWhitespace();
+    const char c = reader.peek();
+    if (c != '{' && c != '[')
+    {
+        QJsonTreeItem scalar;
+        reader.parseScalarItem(&scalar);
+        itemToJson(&scalar, sink, indent, compact);
+        return;
+    }
 
-void QJsonModel::arrayToJson(QJsonArray jsonArray, QByteArray &json, int indent, bool compact) const
-{
-    json += compact ? "[" : "[\n";
-    arrayContentToJson(jsonArray, json, indent + (compact ? 0 : 1), compact);
+    const bool isObject = c == '{';
+    QVector<QJsonRawMember> members;
+    indexRaw(begin, end, members);
+
+    const int contentIndent = indent + (compact ? 0 : 1);
+    QByteArray indentString(4 * contentIndent, ' ');
+    json += isObject ? '{' : '[';
+    if (!compact)
+        json += '\n';
+    for (int i = 0; i < members.size(); ++i)
+    {
+        json += indentString;
+        if (isObject)
+        {
+            json += '"';
+            appendEscapedString(members.at(i).key, json);
+            json += compact ? "\":" : "\": ";
+        }
+        rawToJson(members.at(i).begin, members.at(i).end, sink, contentIndent, compact);
+        if (i + 1 == members.size())
+        {
+            if (!compact)
+                json += '\n';
+        }
+        else
+        {
+            json += compact ? "," : ",\n";
+        }
+        sink.flush();
+    }
     json += QByteArray(4 * indent, ' ');
-    json += compact ? "]" : "]\n";
+    json += isObject ? '}' : ']';
 }
 
-void QJsonModel::arrayContentToJson(QJsonArray jsonArray, QByteArray &json, int indent, bool compact) const
+void QJsonModel::arrayContentToJson(const QJsonArray &jsonArray, QJsonSaveSink &sink, int indent, bool compact) const
 {
+    QByteArray &json = sink.buffer;
     if (jsonArray.size() <= 0)
     {
         return;
@@ -481,7 +6547,7 @@ void QJsonModel::arrayContentToJson(QJsonArray jsonArray, QByteArray &json, int
     while (1)
     {
         json += indentString;
-        valueToJson(jsonArray.at(i), json, indent, compact);
+        valueToJson(jsonArray.at(i), sink, indent, compact);
         if (++i == jsonArray.size())
         {
             if (!compact)
@@ -489,36 +6555,40 @@ void QJsonModel::arrayContentToJson(QJsonArray jsonArray, QByteArray &json, int
             break;
         }
         json += compact ? "," : ",\n";
+        sink.flush();
     }
 }
-void QJsonModel::objectContentToJson(QJsonObject jsonObject, QByteArray &json, int indent, bool compact) const
+void QJsonModel::objectContentToJson(const QJsonObject &jsonObject, QJsonSaveSink &sink, int indent, bool compact) const
 {
+    QByteArray &json = sink.buffer;
     if (jsonObject.size() <= 0)
     {
         return;
     }
     QByteArray indentString(4 * indent, ' ');
-    int i = 0;
+    const auto end = jsonObject.constEnd();
+    auto it = jsonObject.constBegin();
     while (1)
     {
-        QString key = jsonObject.keys().at(i);
         json += indentString;
         json += '"';
-        json += escapedString(key);
+        appendEscapedString(it.key(), json);
         json += compact ? "\":" : "\": ";
-        valueToJson(jsonObject.value(key), json, indent, compact);
-        if (++i == jsonObject.size())
+        valueToJson(it.value(), sink, indent, compact);
+        if (++it == end)
         {
             if (!compact)
                 json += '\n';
             break;
         }
         json += compact ? "," : ",\n";
+        sink.flush();
     }
 }
 
-void QJsonModel::valueToJson(QJsonValue jsonValue, QByteArray &json, int indent, bool compact) const
+void QJsonModel::valueToJson(const QJsonValue &jsonValue, QJsonSaveSink &sink, int indent, bool compact) const
 {
+    QByteArray &json = sink.buffer;
     QJsonValue::Type type = jsonValue.type();
     switch (type)
     {
@@ -526,32 +6596,22 @@ void QJsonModel::valueToJson(QJsonValue jsonValue, QByteArray &json, int indent,
         json += jsonValue.toBool() ? "true" : "false";
         break;
     case QJsonValue::Double:
-    {
-        const double d = jsonValue.toDouble();
-        if (qIsFinite(d))
-        {
-            json += QByteArray::number(d, 'f', QLocale::FloatingPointShortest);
-        }
-        else
-        {
-            json += "null"; // +INF || -INF || NaN (see RFC4627#section2.4)
-        }
+        doubleToJson(jsonValue.toDouble(), json);
         break;
-    }
     case QJsonValue::String:
         json += '"';
-        json += escapedString(jsonValue.toString());
+        appendEscapedString(jsonValue.toString(), json);
         json += '"';
         break;
     case QJsonValue::Array:
         json += compact ? "[" : "[\n";
-        arrayContentToJson(jsonValue.toArray(), json, indent + (compact ? 0 : 1), compact);
+        arrayContentToJson(jsonValue.toArray(), sink, indent + (compact ? 0 : 1), compact);
         json += QByteArray(4 * indent, ' ');
         json += ']';
         break;
     case QJsonValue::Object:
         json += compact ? "{" : "{\n";
-        objectContentToJson(jsonValue.toObject(), json, indent + (compact ? 0 : 1), compact);
+        objectContentToJson(jsonValue.toObject(), sink, indent + (compact ? 0 : 1), compact);
         json += QByteArray(4 * indent, ' ');
         json += '}';
         break;
@@ -564,8 +6624,8 @@ void QJsonModel::valueToJson(QJsonValue jsonValue, QByteArray &json, int indent,
 void QJsonModel::clear()
 {
    beginResetModel();
-   delete mRootItem;
-   mRootItem = new QJsonTreeItem();
+   auto arena = new QJsonTreeArena;
+   resetRoot(arena->create(), arena);
    endResetModel();
 }
 
@@ -583,32 +6643,518 @@ void QJsonModel::setMode(const Mode& newMode)
    emit modeChanged(mMode);
 }
 
-QJsonValue QJsonModel::genJson(QJsonTreeItem* item) const
+bool QJsonModel::lazyLoading() const
+{
+   return mLazyLoading;
+}
+
+void QJsonModel::setLazyLoading(bool lazy)
+{
+   mLazyLoading = lazy;
+}
+
+int QJsonModel::buildThreads() const
+{
+   return mBuildThreads;
+}
+
+void QJsonModel::setBuildThreads(int threads)
+{
+   mBuildThreads = qMax(0, threads);
+}
+
+qint64 QJsonModel::parallelThreshold() const
+{
+   return mParallelThreshold;
+}
+
+void QJsonModel::setParallelThreshold(qint64 bytes)
+{
+   mParallelThreshold = qMax<qint64>(0, bytes);
+}
+
+int QJsonModel::buildThreadsFor(qint64 size) const
+{
+   if (size < mParallelThreshold) {
+      return 1;
+   }
+   return mBuildThreads > 0 ? mBuildThreads : QThread::idealThreadCount();
+}
+
+int QJsonModel::fetchBatchSize() const
+{
+   return mFetchBatchSize;
+}
+
+const QJsonKeyPool& QJsonModel::keyPool() const
+{
+   return mArena->keys();
+}
+
+void QJsonModel::setFetchBatchSize(int size)
+{
+   mFetchBatchSize = qMax(1, size);
+}
+
+int QJsonModel::keyIndexThreshold() const
+{
+   return mKeyIndexThreshold;
+}
+
+void QJsonModel::setKeyIndexThreshold(int count)
+{
+   mKeyIndexThreshold = qMax(0, count);
+   mKeyIndex.clear();
+}
+
+QJsonTreeItem* QJsonModel::buildTree(const QJsonValue& value, QJsonTreeArena* arena) const
+{
+   return mLazyLoading ? QJsonTreeItem::loadLazy(value, nullptr, arena) : QJsonTreeItem::load(value, nullptr, arena);
+}
+
+QJsonTreeItem* QJsonModel::internalData(const QModelIndex& index) const
+{
+   return static_cast<QJsonTreeItem*>(index.internalPointer());
+}
+
+//---------------------------------------------------
+
+/// The filters of a QJsonFilterProxyModel, compiled once per pass.
+class QJsonFilter
 {
-   auto type = item->type();
-   int nchild = item->childCount();
+public:
+   QJsonFilter(const QString& key, Qt::MatchFlags keyFlags, const QString& value, Qt::MatchFlags valueFlags,
+               const QList<QJsonValue::Type>& types, const QString& pointer, Qt::MatchFlags pointerFlags)
+      : mKey(key, keyFlags)
+      , mValue(value, valueFlags)
+      , mPointer(pointer, pointerFlags)
+      , mTypes(types)
+   {
+   }
+
+   bool needsPointer() const
+   {
+      return !mPointer.text().isEmpty();
+   }
 
-   if (QJsonValue::Object == type) {
-      QJsonObject jo;
-      for (int i = 0; i < nchild; ++i) {
-         auto ch = item->child(i);
-         auto key = ch->key();
-         jo.insert(key, genJson(ch));
+   bool matches(const QJsonTreeItem* item, const QString& pointer) const
+   {
+      QString text;
+      if (!mTypes.isEmpty() && !mTypes.contains(item->type())) {
+         return false;
       }
-      return jo;
-   } else if (QJsonValue::Array == type) {
-      QJsonArray arr;
-      for (int i = 0; i < nchild; ++i) {
-         auto ch = item->child(i);
-         arr.append(genJson(ch));
+      if (!mKey.text().isEmpty() && !(searchText(item, 0, &text) && mKey.matches(text))) {
+         return false;
       }
-      return arr;
-   } else {
-      return QJsonValue::fromVariant(item->value());
+      if (!mValue.text().isEmpty() && !(searchText(item, 1, &text) && mValue.matches(text))) {
+         return false;
+      }
+      return !needsPointer() || mPointer.matches(pointer);
    }
+
+private:
+   QJsonMatcher mKey;
+   QJsonMatcher mValue;
+   QJsonMatcher mPointer;
+   QList<QJsonValue::Type> mTypes;
+};
+
+static QString pointerToken(const QJsonTreeItem* item)
+{
+   QString token = item->key();
+   return token.replace(QLatin1Char('~'), QLatin1String("~0")).replace(QLatin1Char('/'), QLatin1String("~1"));
 }
 
-QJsonTreeItem* QJsonModel::internalData(const QModelIndex& index) const
+QJsonFilterProxyModel::QJsonFilterProxyModel(QObject* parent)
+    : QAbstractProxyModel(parent)
+    , mModel{nullptr}
+    , mKeyFlags{Qt::MatchContains}
+    , mValueFlags{Qt::MatchContains}
+    , mPointerFlags{Qt::MatchWildcard}
+    , mChanging{0}
+    , mRebuilding{false}
+{
+}
+
+void QJsonFilterProxyModel::setSourceModel(QAbstractItemModel* sourceModel)
+{
+   auto model = qobject_cast<QJsonModel*>(sourceModel);
+   if (sourceModel && !model) {
+      qDebug() << Q_FUNC_INFO << "the source is not a QJsonModel";
+      return;
+   }
+
+   beginResetModel();
+   if (mModel) {
+      disconnect(mModel, nullptr, this, nullptr);
+   }
+   QAbstractProxyModel::setSourceModel(model);
+   mModel = model;
+   mChanging = 0;
+   if (mModel) {
+      connect(mModel, &QObject::destroyed, this, [this]() {
+         beginResetModel();
+         mModel = nullptr;
+         mRows.clear();
+         mMatches.clear();
+         endResetModel();
+      });
+      connect(mModel, &QAbstractItemModel::dataChanged, this, &QJsonFilterProxyModel::sourceDataChanged);
+      connect(mModel, &QAbstractItemModel::headerDataChanged, this, &QAbstractItemModel::headerDataChanged);
+      connect(mModel, &QAbstractItemModel::rowsAboutToBeInserted, this, &QJsonFilterProxyModel::sourceAboutToChange);
+      connect(mModel, &QAbstractItemModel::rowsInserted, this, &QJsonFilterProxyModel::sourceChanged);
+      connect(mModel, &QAbstractItemModel::rowsAboutToBeRemoved, this, &QJsonFilterProxyModel::sourceAboutToChange);
+      connect(mModel, &QAbstractItemModel::rowsRemoved, this, &QJsonFilterProxyModel::sourceChanged);
+      connect(mModel, &QAbstractItemModel::rowsAboutToBeMoved, this, &QJsonFilterProxyModel::sourceAboutToChange);
+      connect(mModel, &QAbstractItemModel::rowsMoved, this, &QJsonFilterProxyModel::sourceChanged);
+      connect(mModel, &QAbstractItemModel::layoutAboutToBeChanged, this, &QJsonFilterProxyModel::sourceAboutToChange);
+      connect(mModel, &QAbstractItemModel::layoutChanged, this, &QJsonFilterProxyModel::sourceChanged);
+      connect(mModel, &QAbstractItemModel::modelAboutToBeReset, this, &QJsonFilterProxyModel::sourceAboutToChange);
+      connect(mModel, &QAbstractItemModel::modelReset, this, &QJsonFilterProxyModel::sourceChanged);
+   }
+   rebuild();
+   endResetModel();
+}
+
+QJsonModel* QJsonFilterProxyModel::jsonModel() const
+{
+   return mModel;
+}
+
+QModelIndex QJsonFilterProxyModel::mapToSource(const QModelIndex& proxyIndex) const
+{
+   if (!mModel || !proxyIndex.isValid()) {
+      return QModelIndex();
+   }
+   auto item = internalData(proxyIndex);
+   return mModel->createIndex(item->row(), proxyIndex.column(), item);
+}
+
+QModelIndex QJsonFilterProxyModel::mapFromSource(const QModelIndex& sourceIndex) const
+{
+   if (!mModel || !sourceIndex.isValid()) {
+      return QModelIndex();
+   }
+   return proxyIndex(static_cast<QJsonTreeItem*>(sourceIndex.internalPointer()), sourceIndex.column());
+}
+
+QModelIndex QJsonFilterProxyModel::index(int row, int column, const QModelIndex& parent) const
+{
+   if (!mModel || row < 0 || column < 0 || column >= columnCount(parent)) {
+      return QModelIndex();
+   }
+   const auto rows = mRows.constFind(parent.isValid() ? internalData(parent) : mModel->mRootItem);
+   if (rows == mRows.constEnd() || row >= rows->count()) {
+      return QModelIndex();
+   }
+   return createIndex(row, column, rows->at(row));
+}
+
+QModelIndex QJsonFilterProxyModel::parent(const QModelIndex& index) const
+{
+   if (!mModel || !index.isValid()) {
+      return QModelIndex();
+   }
+   auto parentItem = internalData(index)->parent();
+   return parentItem == mModel->mRootItem ? QModelIndex() : proxyIndex(parentItem);
+}
+
+QModelIndex QJsonFilterProxyModel::sibling(int row, int column, const QModelIndex& index) const
+{
+   return index.isValid() ? this->index(row, column, parent(index)) : QModelIndex();
+}
+
+int QJsonFilterProxyModel::rowCount(const QModelIndex& parent) const
+{
+   if (!mModel || parent.column() > 0) {
+      return 0;
+   }
+   return mRows.value(parent.isValid() ? internalData(parent) : mModel->mRootItem).count();
+}
+
+int QJsonFilterProxyModel::columnCount(const QModelIndex& parent) const
+{
+   Q_UNUSED(parent)
+   return mModel ? mModel->columnCount() : 0;
+}
+
+bool QJsonFilterProxyModel::hasChildren(const QModelIndex& parent) const
+{
+   return rowCount(parent) > 0;
+}
+
+QVariant QJsonFilterProxyModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+   // columns are never filtered, rows have no headers
+   return mModel ? mModel->headerData(section, orientation, role) : QVariant();
+}
+
+void QJsonFilterProxyModel::setFilterKey(const QString& text, Qt::MatchFlags flags)
+{
+   mKey = text;
+   mKeyFlags = flags;
+   refilter();
+}
+
+void QJsonFilterProxyModel::setFilterValue(const QString& text, Qt::MatchFlags flags)
+{
+   mValue = text;
+   mValueFlags = flags;
+   refilter();
+}
+
+void QJsonFilterProxyModel::setFilterTypes(const QList<QJsonValue::Type>& types)
+{
+   mTypes = types;
+   refilter();
+}
+
+void QJsonFilterProxyModel::setFilterPointer(const QString& pattern, Qt::MatchFlags flags)
+{
+   mPointer = pattern;
+   mPointerFlags = flags;
+   refilter();
+}
+
+void QJsonFilterProxyModel::clearFilters()
+{
+   mKey.clear();
+   mValue.clear();
+   mTypes.clear();
+   mPointer.clear();
+   refilter();
+}
+
+QString QJsonFilterProxyModel::filterKey() const
+{
+   return mKey;
+}
+
+QString QJsonFilterProxyModel::filterValue() const
+{
+   return mValue;
+}
+
+QList<QJsonValue::Type> QJsonFilterProxyModel::filterTypes() const
+{
+   return mTypes;
+}
+
+QString QJsonFilterProxyModel::filterPointer() const
+{
+   return mPointer;
+}
+
+bool QJsonFilterProxyModel::isFiltered() const
+{
+   return !mKey.isEmpty() || !mValue.isEmpty() || !mTypes.isEmpty() || !mPointer.isEmpty();
+}
+
+int QJsonFilterProxyModel::matchCount() const
+{
+   return mModel ? mMatches.value(mModel->mRootItem) : 0;
+}
+
+void QJsonFilterProxyModel::sourceAboutToChange()
+{
+   // fetching during a rebuild inserts rows the rebuild already accounts for
+   if (!mRebuilding && mChanging++ == 0) {
+      beginResetModel();
+   }
+}
+
+void QJsonFilterProxyModel::sourceChanged()
+{
+   if (!mRebuilding && mChanging > 0 && --mChanging == 0) {
+      rebuild();
+      endResetModel();
+   }
+}
+
+void QJsonFilterProxyModel::sourceDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight,
+                                              const QVector<int>& roles)
+{
+   if (mRebuilding || mChanging > 0 || !topLeft.isValid()) {
+      return;
+   }
+
+   auto parentItem = static_cast<QJsonTreeItem*>(topLeft.internalPointer())->parent();
+   for (int row = topLeft.row(); row <= bottomRight.row(); ++row) {
+      itemChanged(parentItem->child(row));
+   }
+
+   // report the rows that stayed visible, in runs of adjacent proxy rows
+   int first = -1;
+   int last = -1;
+   auto flush = [&]() {
+      if (first >= 0) {
+         const auto parent = mapFromSource(topLeft.parent());
+         emit dataChanged(index(first, topLeft.column(), parent), index(last, bottomRight.column(), parent), roles);
+      }
+      first = -1;
+   };
+   for (int row = topLeft.row(); row <= bottomRight.row(); ++row) {
+      const int proxy = proxyRow(parentItem->child(row));
+      if (proxy < 0 || (first >= 0 && proxy != last + 1)) {
+         flush();
+      }
+      if (proxy >= 0) {
+         first = first < 0 ? proxy : first;
+         last = proxy;
+      }
+   }
+   flush();
+}
+
+void QJsonFilterProxyModel::refilter()
+{
+   beginResetModel();
+   rebuild();
+   endResetModel();
+}
+
+void QJsonFilterProxyModel::rebuild()
+{
+   mRows.clear();
+   mMatches.clear();
+   if (!mModel) {
+      return;
+   }
+
+   // top down: fetch everything and list the items parents first
+   const QJsonFilter filter(mKey, mKeyFlags, mValue, mValueFlags, mTypes, mPointer, mPointerFlags);
+   const bool filtered = isFiltered();
+   QVector<QJsonTreeItem*> items;
+   QVector<QString> pointers;
+   items.append(mModel->mRootItem);
+   pointers.append(QString());
+   mRebuilding = true;
+   for (int i = 0; i < items.count(); ++i) {
+      QJsonTreeItem* item = items.at(i);
+      mModel->fetchAll(item);
+      for (int row = 0; row < item->childCount(); ++row) {
+         items.append(item->child(row));
+         if (filter.needsPointer()) {
+            pointers.append(pointers.at(i) + QLatin1Char('/') + pointerToken(item->child(row)));
+         }
+      }
+   }
+   mRebuilding = false;
+
+   // bottom up: count the matches below every item and keep the visible rows
+   for (int i = items.count() - 1; i >= 0; --i) {
+      QJsonTreeItem* item = items.at(i);
+      int count = 0;
+      if (i > 0 && (!filtered || filter.matches(item, filter.needsPointer() ? pointers.at(i) : QString()))) {
+         count = 1;
+      }
+      QVector<QJsonTreeItem*> rows;
+      for (int row = 0; row < item->childCount(); ++row) {
+         const int matches = mMatches.value(item->child(row));
+         if (matches > 0) {
+            count += matches;
+            rows.append(item->child(row));
+         }
+      }
+      if (count > 0 || i == 0) {
+         mMatches.insert(item, count);
+      }
+      if (!rows.isEmpty() || i == 0) {
+         mRows.insert(item, rows);
+      }
+   }
+}
+
+void QJsonFilterProxyModel::itemChanged(QJsonTreeItem* item)
+{
+   int below = 0;
+   for (int row = 0; row < item->childCount(); ++row) {
+      below += mMatches.value(item->child(row));
+   }
+   const bool matched = mMatches.value(item) > below;
+
+   QString pointer;
+   const QJsonFilter filter(mKey, mKeyFlags, mValue, mValueFlags, mTypes, mPointer, mPointerFlags);
+   if (filter.needsPointer()) {
+      for (auto ancestor = item; ancestor != mModel->mRootItem; ancestor = ancestor->parent()) {
+         pointer.prepend(QLatin1Char('/') + pointerToken(ancestor));
+      }
+   }
+   const bool matches = !isFiltered() || filter.matches(item, pointer);
+   if (matched == matches) {
+      return;
+   }
+
+   // the items whose visibility flips form a chain from the item upwards;
+   // only its topmost link enters or leaves the rows of a visible parent
+   const int delta = matches ? 1 : -1;
+   QVector<QJsonTreeItem*> chain;
+   for (auto ancestor = item; ancestor != mModel->mRootItem; ancestor = ancestor->parent()) {
+      const int count = mMatches.value(ancestor);
+      if ((count == 0) == (count + delta == 0)) {
+         break;
+      }
+      chain.append(ancestor);
+   }
+
+   for (auto ancestor = item; ancestor; ancestor = ancestor->parent()) {
+      mMatches[ancestor] += delta;
+      if (ancestor != mModel->mRootItem && mMatches.value(ancestor) == 0) {
+         mMatches.remove(ancestor);
+      }
+   }
+
+   if (chain.isEmpty()) {
+      return;
+   }
+
+   QJsonTreeItem* top = chain.last();
+   QJsonTreeItem* parentItem = top->parent();
+   auto& rows = mRows[parentItem];
+   const auto position = std::lower_bound(rows.begin(), rows.end(), top, [](QJsonTreeItem* a, QJsonTreeItem* b) {
+      return a->row() < b->row();
+   });
+   const int row = int(position - rows.begin());
+   const QModelIndex parent = parentItem == mModel->mRootItem ? QModelIndex() : proxyIndex(parentItem);
+
+   if (matches) {
+      beginInsertRows(parent, row, row);
+      rows.insert(row, top);
+      for (int i = 0; i + 1 < chain.count(); ++i) {
+         mRows.insert(chain.at(i + 1), {chain.at(i)});
+      }
+      endInsertRows();
+   }
+   else {
+      beginRemoveRows(parent, row, row);
+      rows.remove(row);
+      for (auto link : qAsConst(chain)) {
+         mRows.remove(link);
+      }
+      endRemoveRows();
+   }
+}
+
+int QJsonFilterProxyModel::proxyRow(QJsonTreeItem* item) const
+{
+   const auto rows = mRows.constFind(item->parent());
+   if (rows == mRows.constEnd() || !mMatches.contains(item)) {
+      return -1;
+   }
+   // visible rows keep the order of the source rows
+   const auto position = std::lower_bound(rows->begin(), rows->end(), item, [](QJsonTreeItem* a, QJsonTreeItem* b) {
+      return a->row() < b->row();
+   });
+   return position != rows->end() && *position == item ? int(position - rows->begin()) : -1;
+}
+
+QModelIndex QJsonFilterProxyModel::proxyIndex(QJsonTreeItem* item, int column) const
+{
+   const int row = proxyRow(item);
+   return row < 0 ? QModelIndex() : createIndex(row, column, item);
+}
+
+QJsonTreeItem* QJsonFilterProxyModel::internalData(const QModelIndex& index) const
 {
    return static_cast<QJsonTreeItem*>(index.internalPointer());
 }
@@ -26,8 +26,13 @@
 #define QJSONMODEL_H
 
 #include <QAbstractItemModel>
+#include <QAbstractProxyModel>
 #include <QJsonArray>
+#include <QFuture>
+#include <QHash>
 #include <QJsonObject>
+#include <QSharedPointer>
+#include <QVector>
 
 namespace QUtf8Functions
 {
@@ -258,16 +263,45 @@ struct QUtf8BaseTraits
     }
 };
 
+class QFile;
+struct QJsonParseError;
 class QJsonModel;
+class QJsonFilterProxyModel;
 class QJsonItem;
+class QCborStreamReader;
+class QCborStreamWriter;
+class QJsonTreeArena;
+class QJsonReader;
+class QJsonSnapshotWriter;
+struct QJsonLoadTask;
+struct QJsonEditStep;
+struct QJsonSearchIndex;
+struct QJsonSearch;
+struct QJsonPathProgram;
+struct QJsonPathRun;
+struct QJsonSnapshot;
+struct QJsonSaveSink;
 
 class QJsonTreeItem
 {
+   friend class QJsonModel;
+   friend class QJsonTreeArena;
+   friend class QJsonReader;
+   friend class QJsonSnapshotWriter;
+   friend class QJsonCborReader;
+   friend class QJsonMsgPackReader;
+
 public:
    QJsonTreeItem(QJsonTreeItem* parent = nullptr);
    ~QJsonTreeItem();
 
    void appendChild(QJsonTreeItem* item);
+   void insertChild(int row, QJsonTreeItem* item);
+   void insertChildren(int row, const QList<QJsonTreeItem*>& items);
+   QJsonTreeItem* takeChild(int row);
+   QList<QJsonTreeItem*> takeChildren(int row, int count);
+   void removeChildren(int row, int count, QJsonTreeArena* arena = nullptr);
+   void moveChild(int from, int to);
    QJsonTreeItem* child(int row);
    QJsonTreeItem* parent();
    int childCount() const;
@@ -283,14 +317,157 @@ public:
    QJsonValue::Type type() const;
 
 
-   static QJsonTreeItem* load(const QJsonValue& value, QJsonTreeItem * parent = nullptr);
+   bool canFetchMore() const;
+   int fetchMore(int count, QJsonTreeArena* arena = nullptr);
+
+   static QJsonTreeItem* create(QJsonTreeItem* parent = nullptr, QJsonTreeArena* arena = nullptr);
+   static void destroy(QJsonTreeItem* item, QJsonTreeArena* arena = nullptr);
+
+   static QJsonTreeItem* load(const QJsonValue& value, QJsonTreeItem * parent = nullptr, QJsonTreeArena* arena = nullptr);
+   static QJsonTreeItem* loadLazy(const QJsonValue& value, QJsonTreeItem * parent = nullptr, QJsonTreeArena* arena = nullptr);
 
 private:
+   struct Pending;
+   struct Container;
+
+   /// How a scalar value is held in the union.
+   enum Storage : quint8
+   {
+      Plain,    // mBool, mDouble or mString, following mType, else mContainer
+      Utf8,     // mUtf8: a string, or the text of a number
+      Integer,  // mInteger
+      Unsigned  // mUnsigned, above the qint64 range
+   };
+
+   static QJsonTreeItem* loadLazy(const char* begin, const char* end, QJsonTreeItem* parent, QJsonTreeArena* arena);
+   static QJsonTreeItem* loadSlot(const QJsonSnapshot* snapshot, const char* slot, QJsonTreeItem* parent, QJsonTreeArena* arena);
+   QJsonTreeItem* loadPending(int index, QJsonTreeItem* parent, QJsonTreeArena* arena) const;
+   template <typename Function>
+   void forEachChild(Function function) const;
+
+   static bool holdsChildren(QJsonValue::Type type);
+   const QList<QJsonTreeItem*>& childs() const;
+   QList<QJsonTreeItem*>& mutableChilds();
+   Pending* pending() const;
+   void setPending(Pending* pending);
+
+   void updateRows(int first, int last);
+   int pendingCount() const;
+   void releaseValue();
+   void setUtf8Value(const char* begin, const char* end, QJsonValue::Type type = QJsonValue::String);
+   QByteArray utf8Value() const;
+   void setInteger(qint64 value);
+   void setUnsigned(quint64 value);
+   void copyValue(const QJsonTreeItem& other);
+   void numberToJson(QByteArray& json) const;
+
+private:
+   QJsonTreeItem* mParent;
    QString mKey;
-   QVariant mValue;
+   union
+   {
+      bool mBool;
+      double mDouble;
+      qint64 mInteger;
+      quint64 mUnsigned;
+      QString mString;
+      QByteArray mUtf8; // a string or number as read, decoded on demand
+      Container* mContainer; // children and pending source, made on demand
+   };
+   int mRow;
+   int mSlot;
    QJsonValue::Type mType;
-   QList<QJsonTreeItem*> mChilds;
-   QJsonTreeItem* mParent;
+   quint8 mStorage;
+};
+
+//---------------------------------------------------
+
+/// Stores each distinct object key once and numbers it. Keys returned by
+/// intern() share their data with the pooled copy, so two interned keys
+/// are equal exactly when they share data.
+class QJsonKeyPool
+{
+public:
+   QJsonKeyPool();
+
+   QString intern(const QString& key, int* id = nullptr);
+   int id(const QString& key) const;
+   QString key(int id) const;
+   void clear();
+
+   static bool equal(const QString& a, const QString& b);
+
+   int count() const;
+   qint64 uses() const;
+   qint64 bytesSaved() const;
+
+private:
+   friend class QJsonTreeArena;
+
+   void merge(const QJsonKeyPool& other, QHash<const QChar*, QString>& shared);
+
+   QHash<QString, int> mIds;
+   QVector<QString> mKeys;
+   QVector<qint64> mUses;
+};
+
+//---------------------------------------------------
+
+/// Allocates QJsonTreeItem nodes in blocks. Items created by an arena belong
+/// to it: their children are not deleted with them, and they are released
+/// with destroy() or all at once by clear(), never with delete. The object
+/// keys of the items are interned in the arena's key pool.
+class QJsonTreeArena
+{
+public:
+   QJsonTreeArena();
+   ~QJsonTreeArena();
+
+   QJsonTreeItem* create(QJsonTreeItem* parent = nullptr);
+   void destroy(QJsonTreeItem* item);
+   void clear();
+   void merge(QJsonTreeArena& other);
+
+   int count() const;
+   int blockCount() const;
+
+   QJsonKeyPool& keys();
+   const QJsonKeyPool& keys() const;
+
+private:
+   Q_DISABLE_COPY(QJsonTreeArena)
+
+   struct Block;
+
+   QJsonKeyPool mKeys;
+   QVector<Block*> mBlocks;
+   QVector<int> mFreeSlots;
+   int mNextSlot;
+   int mCount;
+};
+
+//---------------------------------------------------
+
+/// A compiled JSONPath query: names, wildcards, indexes, slices, unions,
+/// descendants (..) and filters such as [?(@.level == 'error' && @.ts > 0)].
+/// Copies share the compiled query, so it can be compiled once and run on
+/// any model with QJsonModel::query().
+class QJsonPath
+{
+public:
+   QJsonPath();
+   explicit QJsonPath(const QString& expression);
+
+   bool isValid() const;
+   QString expression() const;
+   QString errorString() const;
+
+private:
+   friend class QJsonModel;
+
+   QString mExpression;
+   QString mError;
+   QSharedPointer<const QJsonPathProgram> mProgram;
 };
 
 //---------------------------------------------------
@@ -298,6 +475,7 @@ private:
 class QJsonModel : public QAbstractItemModel
 {
    Q_OBJECT
+   friend class QJsonFilterProxyModel;
    Q_PROPERTY(Mode mode READ mode WRITE setMode NOTIFY modeChanged)
 
 public:
@@ -320,34 +498,232 @@ public:
    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
    Qt::ItemFlags flags(const QModelIndex& index) const override;
+   bool hasChildren(const QModelIndex& parent = QModelIndex()) const override;
+   bool canFetchMore(const QModelIndex& parent) const override;
+   void fetchMore(const QModelIndex& parent) override;
+   bool insertRows(int row, int count, const QModelIndex& parent = QModelIndex()) override;
+   bool removeRows(int row, int count, const QModelIndex& parent = QModelIndex()) override;
+   bool moveRows(const QModelIndex& sourceParent, int sourceRow, int count,
+                 const QModelIndex& destinationParent, int destinationChild) override;
 
 public:
-   bool loadFromFile(const QString& fileName);
-   bool loadFromDevice(QIODevice* device);
+   bool loadFromFile(const QString& fileName, QJsonParseError* error = nullptr);
+   bool loadFromDevice(QIODevice* device, QJsonParseError* error = nullptr);
    bool loadFromValue(const QJsonValue& value);
    bool loadFromDocument(const QJsonDocument& document);
-   bool loadFromRaw(const QByteArray& json);
+   bool loadFromRaw(const QByteArray& json, QJsonParseError* error = nullptr);
+   bool reloadFromFile(const QString& fileName, QJsonParseError* error = nullptr);
+   bool reloadFromRaw(const QByteArray& json, QJsonParseError* error = nullptr);
+   QFuture<bool> loadFromFileAsync(const QString& fileName);
+   QFuture<bool> loadFromRawAsync(const QByteArray& json);
+   void cancelLoad();
+   bool isLoading() const;
    QByteArray json(bool compact = false) const;
+   bool saveToDevice(QIODevice* device, bool compact = false) const;
+   bool saveToFile(const QString& fileName, bool compact = false, bool atomic = true) const;
+   bool loadSnapshot(const QString& fileName);
+   bool loadSnapshot(QIODevice* device);
+   bool saveSnapshot(QIODevice* device) const;
+   bool loadFromCbor(const QByteArray& cbor);
+   bool loadFromCbor(QIODevice* device);
+   QByteArray toCbor() const;
+   bool saveCbor(QIODevice* device) const;
+   bool loadFromMsgPack(const QByteArray& msgpack);
+   bool loadFromMsgPack(QIODevice* device);
+   QByteArray toMsgPack() const;
+   bool saveMsgPack(QIODevice* device) const;
    void clear();
 
+   QModelIndex insertMember(const QModelIndex& parent, int row, const QString& key, const QJsonValue& value);
+   QModelIndex insertElement(const QModelIndex& parent, int row, const QJsonValue& value);
+   bool applyPatch(const QByteArray& patch, QString* error = nullptr);
+   bool applyMergePatch(const QByteArray& patch, QString* error = nullptr);
+
+   QModelIndex indexFromPointer(const QString& pointer, int column = 0);
+   QString pointerFromIndex(const QModelIndex& index) const;
+
+   QModelIndexList query(const QJsonPath& path, int hits = -1);
+   QJsonArray queryValues(const QJsonPath& path, int hits = -1);
+
+   QModelIndexList findKeys(const QString& text, Qt::MatchFlags flags = Qt::MatchContains, int hits = -1);
+   QModelIndexList findValues(const QString& text, Qt::MatchFlags flags = Qt::MatchContains, int hits = -1);
+   void startSearch(const QString& text, Qt::MatchFlags flags = Qt::MatchContains, int column = 1);
+   void cancelSearch();
+   bool isSearching() const;
+
    QJsonModel::Mode mode() const;
    void setMode(const Mode& newMode);
 
+   bool lazyLoading() const;
+   void setLazyLoading(bool lazy);
+
+   int fetchBatchSize() const;
+   void setFetchBatchSize(int size);
+
+   int buildThreads() const;
+   void setBuildThreads(int threads);
+
+   qint64 parallelThreshold() const;
+   void setParallelThreshold(qint64 bytes);
+
+   int keyIndexThreshold() const;
+   void setKeyIndexThreshold(int count);
+
+   bool searchIndexEnabled() const;
+   void setSearchIndexEnabled(bool enabled);
+
+   const QJsonKeyPool& keyPool() const;
+
 signals:
    void modeChanged(const QJsonModel::Mode& mode);
+   void loadProgress(qint64 bytes, qint64 total);
+   void loadFinished(bool success);
+   void searchHits(const QModelIndexList& hits);
+   void searchFinished(bool complete);
 
 private:
-   void objectToJson(QJsonObject jsonObject, QByteArray& json, int indent, bool compact) const;
-   void arrayToJson(QJsonArray jsonArray, QByteArray& json, int indent, bool compact) const;
-   void arrayContentToJson(QJsonArray jsonArray, QByteArray& json, int indent, bool compact) const;
-   void objectContentToJson(QJsonObject jsonObject, QByteArray& json, int indent, bool compact) const;
-   void valueToJson(QJsonValue jsonValue, QByteArray& json, int indent, bool compact) const;
-   QJsonValue genJson(QJsonTreeItem* item) const;
+   void arrayContentToJson(const QJsonArray& jsonArray, QJsonSaveSink& sink, int indent, bool compact) const;
+   void objectContentToJson(const QJsonObject& jsonObject, QJsonSaveSink& sink, int indent, bool compact) const;
+   void valueToJson(const QJsonValue& jsonValue, QJsonSaveSink& sink, int indent, bool compact) const;
+   void itemToJson(const QJsonTreeItem* item, QJsonSaveSink& sink, int indent, bool compact) const;
+   void itemContentToJson(const QJsonTreeItem* item, QJsonSaveSink& sink, int indent, bool compact) const;
+   void rawToJson(const char* begin, const char* end, QJsonSaveSink& sink, int indent, bool compact) const;
+   void itemToCbor(const QJsonTreeItem* item, QCborStreamWriter& writer, QJsonSaveSink& sink) const;
+   void itemToMsgPack(const QJsonTreeItem* item, QJsonSaveSink& sink) const;
+   QJsonTreeItem* buildTree(const QJsonValue& value, QJsonTreeArena* arena) const;
+   bool loadSnapshotData(const QByteArray& data);
+   bool loadCbor(QCborStreamReader& reader, qint64 size);
+   void resetRoot(QJsonTreeItem* root, QJsonTreeArena* arena);
+   void releaseSource();
+   QFuture<bool> startLoad(const QSharedPointer<QJsonLoadTask>& task);
+   void finishLoad(const QSharedPointer<QJsonLoadTask>& task, bool success);
+   void abandonLoad();
+   int buildThreadsFor(qint64 size) const;
+   QJsonTreeItem* editableParent(const QModelIndex& parent);
+   static QString uniqueKey(QJsonTreeItem* object, const QString& key, const QList<QJsonTreeItem*>& pending);
+   void arrayKeysChanged(const QModelIndex& parent, int first, int last = -1);
+   void fetchAll(QJsonTreeItem* item);
+   QModelIndex indexFromItem(QJsonTreeItem* item) const;
+   bool applyOperation(const QJsonObject& operation, QString* error);
+   bool addItem(const QStringList& path, QJsonTreeItem* item, bool created);
+   void replaceItem(QJsonTreeItem* item, const QJsonValue& value);
+   void replaceRoot(QJsonTreeItem* root);
+   void mergeItem(QJsonTreeItem* item, const QJsonObject& patch);
+   void insertItem(QJsonTreeItem* parent, int row, QJsonTreeItem* item, bool created);
+   QJsonTreeItem* detachItem(QJsonTreeItem* parent, int row);
+   void changeValue(QJsonTreeItem* item, const QJsonTreeItem& source);
+   void finishEdit(const QVector<QJsonEditStep>& steps, bool commit);
+   QJsonTreeItem* createItem(const QJsonValue& value);
+   QJsonTreeItem* itemAt(const QStringList& path, int depth);
+   int childRow(QJsonTreeItem* object, const QString& key) const;
+   QJsonTreeItem* memberOf(QJsonTreeItem* object, const QString& key) const;
+   bool selectItems(QJsonTreeItem* item, int segment, QJsonPathRun& run);
+   bool selectDescendants(QJsonTreeItem* item, int segment, QJsonPathRun& run);
+   bool applySelectors(QJsonTreeItem* item, int segment, QJsonPathRun& run);
+   bool testFilter(int expression, QJsonTreeItem* current, QJsonPathRun& run);
+   bool filterOperand(int expression, QJsonTreeItem* current, QJsonPathRun& run, QJsonValue* value);
+   void continueSearch();
+   void prepareSearch(QJsonSearch* search);
+   bool runSearch(QJsonSearch* search, int budget, int hits, QModelIndexList* result);
+   void buildSearchIndex();
+   void dropSearchIndex();
+   void structureChanged();
+   void storeValue(QJsonTreeItem* item, const QJsonTreeItem& source);
+   QJsonValue itemValue(const QJsonTreeItem* item) const;
+   quint64 hashItem(QJsonTreeItem* item, QHash<const QJsonTreeItem*, quint64>& hashes);
+   bool sameItem(const QJsonTreeItem* a, const QJsonTreeItem* b, const QHash<const QJsonTreeItem*, quint64>& hashes) const;
+   void diffItem(QJsonTreeItem* item, QJsonTreeItem* target, const QHash<const QJsonTreeItem*, quint64>& hashes);
+   void updateItem(QJsonTreeItem* item, QJsonTreeItem* target, const QHash<const QJsonTreeItem*, quint64>& hashes);
+   void releaseUnused(QJsonTreeItem* item);
    QJsonTreeItem* internalData(const QModelIndex& index) const;
 
 private:
+   QJsonTreeArena* mArena;
    QJsonTreeItem* mRootItem;
    Mode mMode;
+   bool mLazyLoading;
+   int mFetchBatchSize;
+   int mBuildThreads;
+   qint64 mParallelThreshold;
+   qint64 mSourceSize;
+   QByteArray mSource;
+   QFile* mMappedFile;
+   QJsonSnapshot* mSnapshot;
+   QSharedPointer<QJsonLoadTask> mLoadTask;
+   QVector<QJsonEditStep>* mEditSteps;
+   int mKeyIndexThreshold;
+   mutable QHash<const QJsonTreeItem*, QHash<QString, QJsonTreeItem*>> mKeyIndex;
+   bool mSearchIndexEnabled;
+   QJsonSearchIndex* mSearchIndex;
+   QJsonSearch* mSearch;
+};
+
+//---------------------------------------------------
+
+/// Filters a QJsonModel by key, value, type and JSON Pointer. An item is
+/// shown when it matches every filter that is set, or when one of its
+/// descendants does. Visibility is computed in one bottom-up pass over the
+/// items of the source, lazy ones fetched first, and kept up to date on
+/// dataChanged() without refiltering; structural changes refilter.
+class QJsonFilterProxyModel : public QAbstractProxyModel
+{
+   Q_OBJECT
+
+public:
+   explicit QJsonFilterProxyModel(QObject* parent = nullptr);
+
+   void setSourceModel(QAbstractItemModel* sourceModel) override;
+   QJsonModel* jsonModel() const;
+
+   QModelIndex mapToSource(const QModelIndex& proxyIndex) const override;
+   QModelIndex mapFromSource(const QModelIndex& sourceIndex) const override;
+
+   QModelIndex index(int row, int column, const QModelIndex& parent = QModelIndex()) const override;
+   QModelIndex parent(const QModelIndex& index) const override;
+   QModelIndex sibling(int row, int column, const QModelIndex& index) const override;
+   int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+   int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+   bool hasChildren(const QModelIndex& parent = QModelIndex()) const override;
+   QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+   void setFilterKey(const QString& text, Qt::MatchFlags flags = Qt::MatchContains);
+   void setFilterValue(const QString& text, Qt::MatchFlags flags = Qt::MatchContains);
+   void setFilterTypes(const QList<QJsonValue::Type>& types);
+   void setFilterPointer(const QString& pattern, Qt::MatchFlags flags = Qt::MatchWildcard);
+   void clearFilters();
+
+   QString filterKey() const;
+   QString filterValue() const;
+   QList<QJsonValue::Type> filterTypes() const;
+   QString filterPointer() const;
+
+   bool isFiltered() const;
+   int matchCount() const;
+
+private:
+   void sourceAboutToChange();
+   void sourceChanged();
+   void sourceDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight, const QVector<int>& roles);
+   void refilter();
+   void rebuild();
+   void itemChanged(QJsonTreeItem* item);
+   int proxyRow(QJsonTreeItem* item) const;
+   QModelIndex proxyIndex(QJsonTreeItem* item, int column = 0) const;
+   QJsonTreeItem* internalData(const QModelIndex& index) const;
+
+private:
+   QJsonModel* mModel;
+   QString mKey;
+   Qt::MatchFlags mKeyFlags;
+   QString mValue;
+   Qt::MatchFlags mValueFlags;
+   QList<QJsonValue::Type> mTypes;
+   QString mPointer;
+   Qt::MatchFlags mPointerFlags;
+   int mChanging;
+   bool mRebuilding;
+   QHash<const QJsonTreeItem*, int> mMatches;
+   QHash<const QJsonTreeItem*, QVector<QJsonTreeItem*>> mRows;
 };
 
 #endif // QJSONMODEL_H
@@ -1,4 +1,4 @@
-QT += testlib core
+QT += testlib core concurrent
 QT -= gui
 
 CONFIG += qt console warn_on depend_includepath testcase
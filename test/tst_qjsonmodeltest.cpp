@@ -1,7 +1,13 @@
+#include <QCborArray>
+#include <QCborMap>
+#include <QRandomGenerator>
 #include <QtTest>
 
 #include "qjsonmodel.h"
 
+#include <cstring>
+#include <limits>
+
 class QJsonModelTest : public QObject
 {
    Q_OBJECT
@@ -15,7 +21,35 @@ private slots:
    void loadFromDocument();
    void loadFromValue();
    void loadFromRaw();
+   void loadFromRawErrors_data();
+   void loadFromRawErrors();
+   void parser();
+   void jsonIndented();
+   void jsonEscaping();
+   void jsonUtf8();
+   void jsonNumbers();
+   void jsonIntegers();
+   void saveToDevice();
+   void saveToFile();
+   void snapshot();
+   void cborMsgPack();
    void clear();
+   void treeItemRows();
+   void treeItemValues();
+   void treeArena();
+   void keyPool();
+   void parallelBuild();
+   void lazyLoading();
+   void lazyLoadingFromFile();
+   void loadAsync();
+   void editRows();
+   void patch();
+   void mergePatch();
+   void reload();
+   void pointer();
+   void search();
+   void filterProxy();
+   void query();
 
 private:
    QByteArray _json;
@@ -94,6 +128,403 @@ void QJsonModelTest::loadFromRaw()
    QCOMPARE(model.json(true), _json);
 }
 
+void QJsonModelTest::loadFromRawErrors_data()
+{
+   QTest::addColumn<QByteArray>("json");
+   QTest::addColumn<int>("error");
+   QTest::addColumn<int>("offset");
+
+   QTest::newRow("empty") << QByteArray() << int(QJsonParseError::IllegalValue) << 0;
+   QTest::newRow("scalar") << QByteArray("  42") << int(QJsonParseError::IllegalValue) << 2;
+   QTest::newRow("separator") << QByteArray("{\"a\": [1, 2}") << int(QJsonParseError::MissingValueSeparator) << 11;
+   QTest::newRow("name separator") << QByteArray("{\"a\" 1}") << int(QJsonParseError::MissingNameSeparator) << 5;
+   QTest::newRow("unterminated array") << QByteArray("[1, 2") << int(QJsonParseError::UnterminatedArray) << 5;
+   QTest::newRow("unterminated string") << QByteArray("[\"abc") << int(QJsonParseError::UnterminatedString) << 5;
+   QTest::newRow("number") << QByteArray("[1.]") << int(QJsonParseError::IllegalNumber) << 3;
+   QTest::newRow("escape") << QByteArray("[\"\\x\"]") << int(QJsonParseError::IllegalEscapeSequence) << 3;
+   QTest::newRow("utf8") << QByteArray("[\"bad\xff\"]") << int(QJsonParseError::IllegalUTF8String) << 5;
+   QTest::newRow("literal") << QByteArray("[nul]") << int(QJsonParseError::IllegalValue) << 1;
+   QTest::newRow("garbage") << QByteArray("[] []") << int(QJsonParseError::GarbageAtEnd) << 3;
+}
+
+void QJsonModelTest::loadFromRawErrors()
+{
+   QFETCH(QByteArray, json);
+   QFETCH(int, error);
+   QFETCH(int, offset);
+
+   for (bool lazy : {false, true}) {
+      QJsonModel model;
+      model.setLazyLoading(lazy);
+      QJsonParseError parseError;
+      QVERIFY(!model.loadFromRaw(json, &parseError));
+      QCOMPARE(int(parseError.error), error);
+      QCOMPARE(parseError.offset, offset);
+   }
+}
+
+void QJsonModelTest::parser()
+{
+   QJsonModel model;
+   QJsonParseError error;
+   QVERIFY(model.loadFromRaw("{\"b\": 1, \"a\": [true, null, -1.5e2], \"b\": \"\\u00e9\\ud83d\\ude00\\n\"}", &error));
+   QCOMPARE(error.error, QJsonParseError::NoError);
+
+   // members are sorted and the last duplicate wins, like QJsonObject
+   QCOMPARE(model.rowCount(), 2);
+   QCOMPARE(model.index(0, 0).data().toString(), QString("a"));
+   QCOMPARE(model.index(1, 1).data().toString(), QString::fromUtf8("\xc3\xa9\xf0\x9f\x98\x80\n"));
+
+   const QModelIndex array = model.index(0, 0);
+   QCOMPARE(model.rowCount(array), 3);
+   QCOMPARE(model.index(0, 1, array).data(), QVariant(true));
+   QCOMPARE(model.index(2, 1, array).data().toDouble(), -150.0);
+   QCOMPARE(model.json(true), QByteArray("{\"a\":[true,null,-150],\"b\":\"\xc3\xa9\xf0\x9f\x98\x80\\n\"}"));
+}
+
+void QJsonModelTest::jsonIndented()
+{
+   auto doc = QJsonDocument::fromJson(_json);
+
+   QJsonModel model;
+   QVERIFY(model.loadFromRaw(_json));
+   QCOMPARE(model.json(), doc.toJson(QJsonDocument::Indented));
+
+   model.setLazyLoading(true);
+   QVERIFY(model.loadFromRaw(_json));
+   model.fetchMore(QModelIndex());
+   QCOMPARE(model.json(), doc.toJson(QJsonDocument::Indented));
+}
+
+void QJsonModelTest::jsonEscaping()
+{
+   // escapes and non-ASCII text at every offset of a vector block
+   QJsonArray strings;
+   const QStringList specials{"\"", "\\", "\n", "\t", "\x01", "\x1f", "\x7f",
+                              QString::fromUtf8("\xc3\xa9"), QString::fromUtf8("\xf0\x9f\x98\x80")};
+   for (int offset = 0; offset < 40; ++offset) {
+      for (const auto& special : specials) {
+         QString text(offset, QLatin1Char('a'));
+         text += special;
+         text += QString(offset % 7, QLatin1Char('b'));
+         strings.append(text);
+      }
+   }
+   strings.append(QString(1000, QLatin1Char('\n')));
+
+   QJsonModel model;
+   QVERIFY(model.loadFromValue(strings));
+   QCOMPARE(model.json(true), QJsonDocument(strings).toJson(QJsonDocument::Compact));
+
+   // a lone surrogate is written as an escape
+   QVERIFY(model.loadFromValue(QJsonArray{QString(QChar(0xd800)) + "x"}));
+   QCOMPARE(model.json(true), QByteArray("[\"\\ud800x\"]"));
+}
+
+void QJsonModelTest::jsonUtf8()
+{
+   // strings without escapes are written back as they were read
+   const QByteArray raw("[\"plain\",\"caf\xc3\xa9 \xf0\x9f\x98\x80\",\"tab\\t\",\"\xef\xbb\xbf" "bom\",\"\"]");
+   QJsonModel model;
+   QVERIFY(model.loadFromRaw(raw));
+   QCOMPARE(model.index(1, 1).data().toString(), QString::fromUtf8("caf\xc3\xa9 \xf0\x9f\x98\x80"));
+   QCOMPARE(model.index(2, 1).data().toString(), QString("tab\t"));
+   QCOMPARE(model.index(3, 1).data().toString(), QString(QChar(0xfeff)) + "bom");
+   QCOMPARE(model.index(4, 1).data().toString(), QString(""));
+   QCOMPARE(model.json(true), QByteArray("[\"plain\",\"caf\xc3\xa9 \xf0\x9f\x98\x80\",\"tab\\t\",\"\xef\xbb\xbf" "bom\",\"\"]"));
+
+   // malformed UTF-8 is an error, as for QJsonDocument
+   QJsonModel invalid;
+   QVERIFY(!invalid.loadFromRaw("[\"bad\xff\"]"));
+   QVERIFY(!invalid.loadFromRaw("{\"\xc0\xaf\":1}"));
+
+   // edited strings are written from their new value
+   QVERIFY(model.setData(model.index(0, 1), "new \"value\""));
+   QVERIFY(model.json(true).startsWith("[\"new \\\"value\\\"\",\"caf"));
+
+   QJsonModel lazy;
+   lazy.setLazyLoading(true);
+   QVERIFY(lazy.loadFromRaw("\"caf\xc3\xa9\""));
+   QCOMPARE(lazy.json(true), QByteArray("\"caf\xc3\xa9\""));
+
+   // a byte order mark is kept in keys and after escapes too
+   QVERIFY(model.loadFromRaw("{\"\xef\xbb\xbfkey\":\"a\\t\xef\xbb\xbf" "b\"}"));
+   QCOMPARE(model.index(0, 0).data().toString(), QString(QChar(0xfeff)) + "key");
+   QCOMPARE(model.index(0, 1).data().toString(), QString("a\t") + QChar(0xfeff) + "b");
+}
+
+void QJsonModelTest::jsonNumbers()
+{
+   const QJsonArray numbers{0, -0.0, 7, -42, 0.1, 0.3, -2.5, 123.456, 1e21, 1.5e-5, 0.001, 9007199254740992.0,
+                            1.7976931348623157e308, 5e-324, std::numeric_limits<double>::infinity()};
+   QJsonModel model;
+   QVERIFY(model.loadFromValue(numbers));
+   QCOMPARE(model.json(true), QByteArray("[0,-0,7,-42,0.1,0.3,-2.5,123.456,1e21,1.5e-5,1e-3,9007199254740992,"
+                                         "1.7976931348623157e308,5e-324,null]"));
+
+   // every double reads back as itself
+   QJsonArray random;
+   for (int i = 0; i < 10000; ++i) {
+      const quint64 bits = QRandomGenerator::global()->generate64();
+      double d;
+      std::memcpy(&d, &bits, sizeof(d));
+      random.append(qIsFinite(d) ? d : double(i) / 7);
+   }
+   QVERIFY(model.loadFromValue(random));
+   const QJsonArray written = QJsonDocument::fromJson(model.json(true)).array();
+   QCOMPARE(written.count(), random.count());
+   for (int i = 0; i < random.count(); ++i) {
+      QVERIFY2(written.at(i).toDouble() == random.at(i).toDouble(), model.json(true).split(',').at(i).constData());
+   }
+}
+
+void QJsonModelTest::jsonIntegers()
+{
+   // integers and decimals past double precision are written as they were read
+   const QByteArray json("[9007199254740993,-9223372036854775808,18446744073709551615,123456789012345678901234,"
+                         "0.1000000000000000055511151231257827,1e400,4.9e-324,-0,2.50,42]");
+   QJsonModel model;
+   QVERIFY(model.loadFromRaw(json));
+   QCOMPARE(model.json(true), QByteArray("[9007199254740993,-9223372036854775808,18446744073709551615,123456789012345678901234,"
+                                         "0.1000000000000000055511151231257827,1e400,4.9e-324,-0,2.5,42]"));
+
+   QCOMPARE(model.index(0, 1).data().userType(), int(QMetaType::LongLong));
+   QCOMPARE(model.index(0, 1).data().toLongLong(), Q_INT64_C(9007199254740993));
+   QCOMPARE(model.index(1, 1).data().toLongLong(), std::numeric_limits<qint64>::min());
+   QCOMPARE(model.index(2, 1).data().toULongLong(), std::numeric_limits<quint64>::max());
+   QCOMPARE(model.index(4, 1).data().toDouble(), 0.1);
+   QCOMPARE(model.index(9, 1).data().userType(), int(QMetaType::Double));
+
+   QVERIFY(model.setData(model.index(9, 1), QVariant(Q_INT64_C(9007199254740995))));
+   QVERIFY(model.json(true).endsWith(",9007199254740995]"));
+
+   QJsonModel lazy;
+   lazy.setLazyLoading(true);
+   QVERIFY(lazy.loadFromRaw(json));
+   QCOMPARE(lazy.json(true), model.json(true).replace("9007199254740995", "42"));
+}
+
+void QJsonModelTest::saveToDevice()
+{
+   QByteArray large = "[";
+   for (int i = 0; i < 20000; ++i) {
+      large += (i ? ",{\"index\":" : "{\"index\":") + QByteArray::number(i) + "}";
+   }
+   large += "]";
+
+   for (const auto& json : {_json, large}) {
+      QJsonModel model;
+      QVERIFY(model.loadFromRaw(json));
+
+      for (bool compact : {true, false}) {
+         QBuffer buffer;
+         QVERIFY(buffer.open(QIODevice::WriteOnly));
+         QVERIFY(model.saveToDevice(&buffer, compact));
+         QCOMPARE(buffer.data(), model.json(compact));
+      }
+   }
+
+   QJsonModel model;
+   QBuffer readOnly;
+   QVERIFY(readOnly.open(QIODevice::ReadOnly));
+   QVERIFY(!model.saveToDevice(&readOnly));
+}
+
+void QJsonModelTest::saveToFile()
+{
+   QTemporaryDir dir;
+   QVERIFY(dir.isValid());
+
+   QJsonModel model;
+   QVERIFY(model.loadFromRaw(_json));
+
+   for (bool atomic : {true, false}) {
+      const QString fileName = dir.filePath(atomic ? "atomic.json" : "plain.json");
+      QVERIFY(model.saveToFile(fileName, true, atomic));
+
+      QFile file(fileName);
+      QVERIFY(file.open(QIODevice::ReadOnly));
+      QCOMPARE(file.readAll(), _json);
+   }
+}
+
+void QJsonModelTest::snapshot()
+{
+   const QByteArray json("{\"empty\":{},\"ids\":[1,-2,18446744073709551615,0.1,1e400,true,false,null],"
+                         "\"none\":[],\"text\":[\"caf\xc3\xa9\",\"tab\\t\"]}");
+   QJsonModel model;
+   QVERIFY(model.loadFromRaw(json));
+
+   QBuffer buffer;
+   QVERIFY(buffer.open(QIODevice::ReadWrite));
+   QVERIFY(model.saveSnapshot(&buffer));
+   QVERIFY(buffer.seek(0));
+
+   // nothing below the root is decoded before it is fetched
+   QJsonModel loaded;
+   QVERIFY(loaded.loadSnapshot(&buffer));
+   QVERIFY(loaded.canFetchMore(QModelIndex()));
+   QCOMPARE(loaded.json(true), json);
+   QCOMPARE(loaded.rowCount(), 0);
+
+   // an unfetched snapshot writes the same snapshot again
+   QBuffer again;
+   QVERIFY(again.open(QIODevice::WriteOnly));
+   QVERIFY(loaded.saveSnapshot(&again));
+   QCOMPARE(again.data(), buffer.data());
+
+   loaded.fetchMore(QModelIndex());
+   QCOMPARE(loaded.rowCount(), 4);
+   const QModelIndex ids = loaded.indexFromPointer("/ids");
+   loaded.fetchMore(ids);
+   QCOMPARE(loaded.index(2, 1, ids).data().toULongLong(), std::numeric_limits<quint64>::max());
+   QCOMPARE(loaded.index(5, 1, ids).data().toBool(), true);
+   QCOMPARE(loaded.indexFromPointer("/text/1", 1).data().toString(), QString("tab\t"));
+   QCOMPARE(loaded.json(true), json);
+
+   // lazy items write the children they have not fetched yet
+   QJsonModel lazy;
+   lazy.setLazyLoading(true);
+   QVERIFY(lazy.loadFromRaw(_json));
+   QTemporaryDir dir;
+   QVERIFY(dir.isValid());
+   QSaveFile file(dir.filePath("sample.qjsn"));
+   QVERIFY(file.open(QIODevice::WriteOnly));
+   QVERIFY(lazy.saveSnapshot(&file));
+   QVERIFY(file.commit());
+
+   QVERIFY(loaded.loadSnapshot(dir.filePath("sample.qjsn")));
+   QCOMPARE(loaded.json(true), _json);
+   QCOMPARE(loaded.json(false), lazy.json(false));
+
+   QBuffer garbage;
+   garbage.setData(_json);
+   QVERIFY(garbage.open(QIODevice::ReadOnly));
+   QVERIFY(!loaded.loadSnapshot(&garbage));
+   QCOMPARE(loaded.json(true), _json);
+   QVERIFY(!loaded.loadSnapshot(dir.filePath("missing.qjsn")));
+
+   // a one element array, the element a string body or the array itself
+   auto makeSnapshot = [](const QByteArray& text, quint8 tag, bool cyclic) {
+      QByteArray data("QJSN", 4);
+      auto append = [&data](quint64 value, int size) {
+         for (int i = 0; i < size; ++i) {
+            data += char(value >> (8 * i));
+         }
+      };
+      auto appendSlot = [&append](quint8 tag, quint64 payload) {
+         append(0xffffffff, 4);
+         append(tag, 4);
+         append(payload, 8);
+      };
+      const quint8 arrayTag = 10;
+      append(1, 4);
+      append(quint64(text.size()), 4);
+      data += text;
+      const quint64 array = quint64(data.size());
+      append(1, 8);
+      appendSlot(tag, cyclic ? array : 8);
+      const quint64 keys = quint64(data.size());
+      append(0, 4);
+      appendSlot(arrayTag, array);
+      append(keys, 8);
+      append(quint64(data.size()) + 8, 8);
+      return data;
+   };
+   auto loadData = [&loaded](const QByteArray& data) {
+      QBuffer buffer;
+      buffer.setData(data);
+      return buffer.open(QIODevice::ReadOnly) && loaded.loadSnapshot(&buffer);
+   };
+   const quint8 utf8Tag = 7;
+   const quint8 numberTag = 8;
+   QVERIFY(loadData(makeSnapshot("a", utf8Tag, false)));
+   QCOMPARE(loaded.json(true), QByteArray("[\"a\"]"));
+
+   // corrupt snapshots fail to load instead of writing broken JSON later
+   QVERIFY(!loadData(makeSnapshot("a\"b", utf8Tag, false)));
+   QVERIFY(!loadData(makeSnapshot("bad\xff", utf8Tag, false)));
+   QVERIFY(!loadData(makeSnapshot("1x", numberTag, false)));
+   QVERIFY(!loadData(makeSnapshot(QByteArray(), 10, true)));
+   QCOMPARE(loaded.json(true), QByteArray("[\"a\"]"));
+}
+
+void QJsonModelTest::cborMsgPack()
+{
+   const QByteArray json("{\"big\":-18446744073709551616,\"ids\":[1,-2,300,-200,70000,18446744073709551615,0.5,true,false,null],"
+                         "\"text\":[\"caf\xc3\xa9\",\"tab\\t\"]}");
+   QJsonModel model;
+   QVERIFY(model.loadFromRaw(json));
+
+   const QByteArray cbor = model.toCbor();
+   QJsonModel loaded;
+   QVERIFY(loaded.loadFromCbor(cbor));
+   QCOMPARE(loaded.json(true), json);
+   QCOMPARE(loaded.index(5, 1, loaded.indexFromPointer("/ids")).data().toULongLong(), std::numeric_limits<quint64>::max());
+
+   // what Qt itself reads and writes
+   const QCborMap map = QCborValue::fromCbor(cbor).toMap();
+   QCOMPARE(map.value(QStringLiteral("ids")).toArray().at(4).toInteger(), qint64(70000));
+   QCOMPARE(map.value(QStringLiteral("text")).toArray().at(0).toString(), QString::fromUtf8("caf\xc3\xa9"));
+
+   QCborMap other;
+   other[1] = QByteArray("\xff\xfe");
+   other[QStringLiteral("t")] = QCborValue(QCborKnownTags::DateTimeString, QStringLiteral("2020-01-01"));
+   QBuffer buffer;
+   buffer.setData(other.toCborValue().toCbor());
+   QVERIFY(buffer.open(QIODevice::ReadOnly));
+   QVERIFY(loaded.loadFromCbor(&buffer));
+   QCOMPARE(loaded.json(true), QByteArray("{\"1\":\"__4\",\"t\":\"2020-01-01\"}"));
+
+   QVERIFY(!loaded.loadFromCbor(cbor.left(cbor.size() - 1)));
+   QVERIFY(!loaded.loadFromCbor(cbor + '\x00'));
+   QVERIFY(!loaded.loadFromCbor(QByteArray("\xff", 1)));
+   QCOMPARE(loaded.json(true), QByteArray("{\"1\":\"__4\",\"t\":\"2020-01-01\"}"));
+
+   // MessagePack has no room for -2^64, which would become a double
+   const QByteArray small = json.mid(0, 1) + json.mid(json.indexOf("\"ids\""));
+   QVERIFY(model.loadFromRaw(small));
+   QVERIFY(loaded.loadFromMsgPack(model.toMsgPack()));
+   QCOMPARE(loaded.json(true), small);
+
+   const QByteArray msgpack("\x82\xa1" "a\x01\xa1" "b\x92\xc3\xcd\x01\x2c", 11);
+   QVERIFY(model.loadFromRaw("{\"a\":1,\"b\":[true,300]}"));
+   QCOMPARE(model.toMsgPack(), msgpack);
+   QVERIFY(loaded.loadFromMsgPack(msgpack));
+   QCOMPARE(loaded.json(true), QByteArray("{\"a\":1,\"b\":[true,300]}"));
+
+   QVERIFY(!loaded.loadFromMsgPack(msgpack.left(msgpack.size() - 1)));
+   QVERIFY(!loaded.loadFromMsgPack(msgpack + '\xc0'));
+   QVERIFY(!loaded.loadFromMsgPack(QByteArray("\xc1", 1)));
+   QCOMPARE(loaded.json(true), QByteArray("{\"a\":1,\"b\":[true,300]}"));
+
+   // saving goes to the device in chunks and reports failed writes
+   class FullDevice : public QIODevice
+   {
+   protected:
+      qint64 readData(char*, qint64) override { return -1; }
+      qint64 writeData(const char*, qint64) override { return -1; }
+   };
+   QByteArray large = "[";
+   for (int i = 0; i < 20000; ++i) {
+      large += (i ? ",{\"index\":" : "{\"index\":") + QByteArray::number(i) + ",\"name\":\"item\"}";
+   }
+   large += "]";
+   QVERIFY(model.loadFromRaw(large));
+   QBuffer saved;
+   QVERIFY(saved.open(QIODevice::WriteOnly));
+   QVERIFY(model.saveCbor(&saved));
+   QCOMPARE(saved.data(), model.toCbor());
+   QBuffer packed;
+   QVERIFY(packed.open(QIODevice::WriteOnly));
+   QVERIFY(model.saveMsgPack(&packed));
+   QCOMPARE(packed.data(), model.toMsgPack());
+   FullDevice full;
+   QVERIFY(full.open(QIODevice::WriteOnly));
+   QVERIFY(!model.saveCbor(&full));
+   QVERIFY(!model.saveMsgPack(&full));
+}
+
 void QJsonModelTest::clear()
 {
    QJsonModel model;
@@ -104,7 +535,668 @@ void QJsonModelTest::clear()
    QVERIFY(json.isEmpty());
 }
 
+void QJsonModelTest::treeItemRows()
+{
+   QJsonTreeItem root;
+   QJsonTreeItem* items[4];
+   for (auto& item : items) {
+      item = new QJsonTreeItem;
+      root.appendChild(item);
+   }
+
+   auto inserted = new QJsonTreeItem;
+   root.insertChild(1, inserted);
+   QCOMPARE(inserted->row(), 1);
+   QCOMPARE(items[3]->row(), 4);
+
+   root.moveChild(4, 0);
+   QCOMPARE(items[3]->row(), 0);
+   QCOMPARE(items[0]->row(), 1);
+   QCOMPARE(inserted->row(), 2);
+
+   auto taken = root.takeChild(2);
+   QCOMPARE(taken, inserted);
+   QVERIFY(!taken->parent());
+   QCOMPARE(items[2]->row(), 3);
+   delete taken;
+
+   for (int i = 0; i < root.childCount(); ++i) {
+      QCOMPARE(root.child(i)->row(), i);
+   }
+}
+
+void QJsonModelTest::treeItemValues()
+{
+   QJsonModel model;
+   QVERIFY(model.loadFromRaw("[10,\"text\",true,null,{\"key\":[1]}]"));
+
+   const auto root = QModelIndex();
+   QCOMPARE(model.index(1, 0, root).data().toString(), QString("1"));
+   QCOMPARE(model.index(0, 1, root).data().toDouble(), 10.0);
+   QCOMPARE(model.index(1, 1, root).data().toString(), QString("text"));
+   QCOMPARE(model.index(2, 1, root).data().toBool(), true);
+   QVERIFY(model.index(3, 1, root).data().isNull());
+   QCOMPARE(model.index(0, 0, model.index(4, 0, root)).data().toString(), QString("key"));
+
+   // a moved array element takes the key of its new position
+   QJsonTreeItem array;
+   array.setType(QJsonValue::Array);
+   for (int i = 0; i < 3; ++i) {
+      auto item = new QJsonTreeItem(&array);
+      item->setValue(i);
+      array.appendChild(item);
+   }
+   array.moveChild(2, 0);
+   QCOMPARE(array.child(0)->key(), QString("0"));
+   QCOMPARE(array.child(0)->value().toDouble(), 2.0);
+
+   // changing the type converts the stored scalar
+   auto item = array.child(1);
+   QCOMPARE(item->type(), QJsonValue::Double);
+   item->setType(QJsonValue::String);
+   QCOMPARE(item->value().toString(), QString("0"));
+   item->setValue(QString("replaced"));
+   QCOMPARE(item->type(), QJsonValue::String);
+   item->setValue(false);
+   QCOMPARE(item->type(), QJsonValue::Bool);
+
+   QVERIFY(!model.setData(model.index(4, 1, root), 5, Qt::EditRole));
+   QVERIFY(!model.setData(QModelIndex(), 5, Qt::EditRole));
+   QVERIFY(model.setData(model.index(0, 1, root), QString("edited"), Qt::EditRole));
+   QCOMPARE(model.json(true), QByteArray("[\"edited\",\"text\",true,null,{\"key\":[1]}]"));
+}
+
+void QJsonModelTest::treeArena()
+{
+   QJsonTreeArena arena;
+   auto doc = QJsonDocument::fromJson(_json);
+   auto root = QJsonTreeItem::load(QJsonValue(doc.object()), nullptr, &arena);
+   const int count = arena.count();
+   QVERIFY(count > 1);
+   QCOMPARE(arena.blockCount(), 1);
+
+   auto phoneNumbers = root->takeChild(root->childCount() - 1);
+   QCOMPARE(phoneNumbers->key(), QString("phoneNumber"));
+   arena.destroy(phoneNumbers);
+   QCOMPARE(arena.count(), count - 7);
+
+   // freed slots are reused before new ones
+   auto item = arena.create(root);
+   root->appendChild(item);
+   QCOMPARE(arena.count(), count - 6);
+
+   arena.clear();
+   QCOMPARE(arena.count(), 0);
+   QCOMPARE(arena.blockCount(), 0);
+}
+
+void QJsonModelTest::keyPool()
+{
+   QJsonKeyPool pool;
+   int first = -1;
+   int second = -1;
+   const QString a = pool.intern(QString("name"), &first);
+   const QString b = pool.intern(QString("na") + QString("me"), &second);
+   QCOMPARE(first, second);
+   QVERIFY(a.isSharedWith(b));
+   QVERIFY(QJsonKeyPool::equal(a, b));
+   QCOMPARE(pool.id("name"), first);
+   QCOMPARE(pool.id("missing"), -1);
+   QCOMPARE(pool.key(first), QString("name"));
+   QCOMPARE(pool.count(), 1);
+   QCOMPARE(pool.uses(), qint64(2));
+   QVERIFY(pool.bytesSaved() > 0);
+
+   QJsonModel model;
+   QVERIFY(model.loadFromRaw("[{\"id\":1,\"name\":\"a\"},{\"id\":2,\"name\":\"b\"},{\"id\":3}]"));
+   QCOMPARE(model.keyPool().count(), 2);
+   QCOMPARE(model.keyPool().uses(), qint64(5));
+
+   const QString key0 = model.index(0, 0, model.index(0, 0)).data().toString();
+   const QString key1 = model.index(0, 0, model.index(1, 0)).data().toString();
+   QVERIFY(key0.isSharedWith(key1));
+
+   model.clear();
+   QCOMPARE(model.keyPool().count(), 0);
+}
+
+void QJsonModelTest::parallelBuild()
+{
+   QByteArray records = "{\"b\":[";
+   for (int i = 0; i < 500; ++i) {
+      records += (i ? "," : "") + QByteArray("{\"id\":") + QByteArray::number(i)
+               + ",\"tags\":[\"x\",{\"deep\":[" + QByteArray::number(i) + "]}],\"id\":" + QByteArray::number(-i) + "}";
+   }
+   records += "],\"a\":" + _json + ",\"c\":[]}";
+
+   QJsonModel serial;
+   QVERIFY(serial.loadFromRaw(records));
+
+   QJsonModel model;
+   model.setBuildThreads(4);
+   model.setParallelThreshold(0);
+   QVERIFY(model.loadFromRaw(records));
+   QCOMPARE(model.json(true), serial.json(true));
+   QCOMPARE(model.keyPool().count(), serial.keyPool().count());
+   QCOMPARE(model.keyPool().uses(), serial.keyPool().uses());
+
+   const auto b = model.index(1, 0);
+   QCOMPARE(model.rowCount(b), 500);
+   QCOMPARE(model.index(499, 0, b).data().toString(), QString("499"));
+   const auto first = model.index(0, 0, model.index(0, 0, b));
+   const auto second = model.index(0, 0, model.index(1, 0, b));
+   QVERIFY(first.data().toString().isSharedWith(second.data().toString()));
+
+   auto tester = new QAbstractItemModelTester(&model, &model);
+   Q_UNUSED(tester)
+
+   // broken text is reported like a serial load reports it
+   QJsonParseError expected;
+   QJsonParseError error;
+   const QByteArray broken = QByteArray(records).replace("\"deep\":[250]", "\"deep\":[250,]");
+   QVERIFY(!serial.loadFromRaw(broken, &expected));
+   QVERIFY(!model.loadFromRaw(broken, &error));
+   QCOMPARE(error.error, expected.error);
+   QCOMPARE(error.offset, expected.offset);
+   QVERIFY(!model.loadFromRaw(records + "]", &error));
+   QCOMPARE(error.error, QJsonParseError::GarbageAtEnd);
+}
+
+void QJsonModelTest::lazyLoading()
+{
+   QJsonModel model;
+   model.setLazyLoading(true);
+   model.setFetchBatchSize(2);
+   QVERIFY(model.loadFromRaw(_json));
+   QCOMPARE(model.rowCount(), 0);
+   QVERIFY(model.hasChildren());
+   QVERIFY(model.canFetchMore(QModelIndex()));
+
+   model.fetchMore(QModelIndex());
+   QCOMPARE(model.rowCount(), 2);
+   QCOMPARE(model.json(true), _json);
+
+   while (model.canFetchMore(QModelIndex())) {
+      model.fetchMore(QModelIndex());
+   }
+   QCOMPARE(model.rowCount(), 5);
+   QCOMPARE(model.json(true), _json);
+
+   QJsonModel testedModel;
+   auto tester = new QAbstractItemModelTester(&testedModel, &testedModel);
+   (void)tester; // shut up warnings;
+   testedModel.setLazyLoading(true);
+   testedModel.setFetchBatchSize(1);
+   QVERIFY(testedModel.loadFromRaw(_json));
+   QCOMPARE(testedModel.json(true), _json);
+}
+
+void QJsonModelTest::lazyLoadingFromFile()
+{
+   QTemporaryDir dir;
+   QVERIFY(dir.isValid());
+   const QString fileName = dir.filePath("sample.json");
+   {
+      QFile file(fileName);
+      QVERIFY(file.open(QIODevice::WriteOnly));
+      QFile sample(":/sample.json");
+      QVERIFY(sample.open(QIODevice::ReadOnly));
+      file.write(sample.readAll());
+   }
+
+   QJsonModel model;
+   model.setLazyLoading(true);
+   QVERIFY(model.loadFromFile(fileName));
+   QCOMPARE(model.json(true), _json);
+
+   while (model.canFetchMore(QModelIndex())) {
+      model.fetchMore(QModelIndex());
+   }
+   QCOMPARE(model.rowCount(), 5);
+   QCOMPARE(model.index(0, 0).data().toString(), QString("address"));
+
+   const QModelIndex address = model.index(0, 0);
+   QVERIFY(model.hasChildren(address));
+   model.fetchMore(address);
+   QCOMPARE(model.rowCount(address), 5);
+   QCOMPARE(model.index(0, 1, address).data().toString(), QString("New York"));
+   QCOMPARE(model.json(true), _json);
+
+   QVERIFY(!model.loadFromRaw("{\"key\": [1, 2}"));
+   QCOMPARE(model.json(true), _json);
+}
+
+void QJsonModelTest::loadAsync()
+{
+   QJsonModel model;
+   QSignalSpy finished(&model, &QJsonModel::loadFinished);
+   QSignalSpy progress(&model, &QJsonModel::loadProgress);
+
+   auto future = model.loadFromRawAsync(_json);
+   QVERIFY(model.isLoading());
+   QVERIFY(finished.wait());
+   QVERIFY(future.result());
+   QCOMPARE(finished.count(), 1);
+   QCOMPARE(finished.at(0).at(0).toBool(), true);
+   QVERIFY(!progress.isEmpty());
+   QCOMPARE(progress.last().at(0).toLongLong(), qint64(_json.size()));
+   QCOMPARE(model.json(true), _json);
+
+   // a newer load makes the pending one stale, it never reaches the model
+   auto stale = model.loadFromRawAsync("[1]");
+   model.loadFromRawAsync("[2,3]");
+   QVERIFY(finished.wait());
+   stale.waitForFinished();
+   QCoreApplication::processEvents();
+   QCOMPARE(finished.count(), 2);
+   QCOMPARE(model.rowCount(), 2);
+
+   auto canceled = model.loadFromFileAsync(":/sample.json");
+   model.cancelLoad();
+   QVERIFY(!model.isLoading());
+   QCOMPARE(finished.count(), 3);
+   QCOMPARE(finished.last().at(0).toBool(), false);
+   canceled.waitForFinished();
+   QCoreApplication::processEvents();
+   QCOMPARE(finished.count(), 3);
+   QCOMPARE(model.rowCount(), 2);
+
+   // a synchronous load replaces a pending one as well
+   model.loadFromRawAsync("[4]");
+   QVERIFY(model.loadFromRaw("[5,6,7]"));
+   QVERIFY(!model.isLoading());
+
+   model.loadFromRawAsync("{");
+   QVERIFY(finished.wait());
+   QCOMPARE(finished.last().at(0).toBool(), false);
+   QCOMPARE(model.rowCount(), 3);
+}
+
+void QJsonModelTest::editRows()
+{
+   QJsonModel model;
+   QVERIFY(model.loadFromRaw("{\"list\":[0,1,2,3],\"map\":{\"a\":1}}"));
+   auto tester = new QAbstractItemModelTester(&model, &model);
+   Q_UNUSED(tester)
+   QSignalSpy reset(&model, &QAbstractItemModel::modelReset);
+   QSignalSpy changed(&model, &QAbstractItemModel::dataChanged);
+
+   const auto list = model.index(0, 0);
+   const auto map = model.index(1, 0);
+
+   QVERIFY(model.insertRows(1, 2, list));
+   QCOMPARE(model.json(true), QByteArray("{\"list\":[0,null,null,1,2,3],\"map\":{\"a\":1}}"));
+   QCOMPARE(model.index(3, 0, list).data().toString(), QString("3"));
+   QCOMPARE(changed.count(), 1);
+   QCOMPARE(changed.last().at(0).toModelIndex(), model.index(3, 0, list));
+
+   QVERIFY(model.removeRows(0, 3, list));
+   QCOMPARE(model.json(true), QByteArray("{\"list\":[1,2,3],\"map\":{\"a\":1}}"));
+   QVERIFY(!model.removeRows(2, 2, list));
+
+   QVERIFY(model.insertRows(0, 2, map));
+   QCOMPARE(model.json(true), QByteArray("{\"list\":[1,2,3],\"map\":{\"key\":null,\"key1\":null,\"a\":1}}"));
+   QVERIFY(!model.insertRows(0, 1, model.index(2, 0, map)));
+
+   QVERIFY(model.moveRows(list, 2, 1, list, 0));
+   QCOMPARE(model.json(true).left(16), QByteArray("{\"list\":[3,1,2],"));
+   QVERIFY(model.moveRows(map, 2, 1, list, 1));
+   QCOMPARE(model.json(true), QByteArray("{\"list\":[3,1,1,2],\"map\":{\"key\":null,\"key1\":null}}"));
+   QVERIFY(model.moveRows(list, 0, 2, map, 0));
+   QCOMPARE(model.json(true), QByteArray("{\"list\":[1,2],\"map\":{\"key2\":3,\"key3\":1,\"key\":null,\"key1\":null}}"));
+   QVERIFY(!model.moveRows(QModelIndex(), 0, 1, list, 0));
+
+   QVERIFY(model.insertMember(map, 0, "b", QJsonArray({true})).isValid());
+   QVERIFY(!model.insertMember(map, 0, "b", 1).isValid());
+   QVERIFY(!model.insertMember(list, 0, "b", 1).isValid());
+   const auto element = model.insertElement(list, 1, QJsonObject({{"x", "y"}}));
+   QCOMPARE(element.data().toString(), QString("1"));
+   QCOMPARE(model.json(true), QByteArray("{\"list\":[1,{\"x\":\"y\"},2],\"map\":{\"b\":[true],\"key2\":3,\"key3\":1,\"key\":null,\"key1\":null}}"));
+   QCOMPARE(reset.count(), 0);
+
+   // rows of a lazy item are all fetched before they are edited
+   QJsonModel lazy;
+   lazy.setLazyLoading(true);
+   lazy.setFetchBatchSize(2);
+   QVERIFY(lazy.loadFromRaw("[0,1,2,3,4]"));
+   QVERIFY(lazy.removeRows(3, 1));
+   QCOMPARE(lazy.rowCount(), 4);
+   QCOMPARE(lazy.json(true), QByteArray("[0,1,2,4]"));
+}
+
+void QJsonModelTest::patch()
+{
+   QJsonModel model;
+   QVERIFY(model.loadFromRaw("{\"a\":{\"b\":[1,2,3]},\"c~/d\":true}"));
+   auto tester = new QAbstractItemModelTester(&model, &model);
+   Q_UNUSED(tester)
+   QSignalSpy reset(&model, &QAbstractItemModel::modelReset);
+   QSignalSpy changed(&model, &QAbstractItemModel::dataChanged);
+   QSignalSpy inserted(&model, &QAbstractItemModel::rowsInserted);
+
+   QVERIFY(model.applyPatch("[{\"op\":\"replace\",\"path\":\"/a/b/1\",\"value\":20}]"));
+   QCOMPARE(changed.count(), 1);
+   QCOMPARE(inserted.count(), 0);
+
+   QString error;
+   QVERIFY(model.applyPatch(R"([
+      {"op":"add","path":"/a/b/-","value":4},
+      {"op":"add","path":"/a/b/0","value":0},
+      {"op":"remove","path":"/c~0~1d"},
+      {"op":"copy","from":"/a/b","path":"/e"},
+      {"op":"move","from":"/a/b/4","path":"/a/last"},
+      {"op":"test","path":"/e/1","value":1},
+      {"op":"replace","path":"/e","value":{"x":null}}
+   ])", &error));
+   QVERIFY(error.isEmpty());
+   QCOMPARE(model.json(true), QByteArray("{\"a\":{\"b\":[0,1,20,3],\"last\":4},\"e\":{\"x\":null}}"));
+
+   // a failing operation undoes the ones before it
+   const QByteArray before = model.json(true);
+   QVERIFY(!model.applyPatch(R"([
+      {"op":"remove","path":"/a/b/0"},
+      {"op":"move","from":"/a","path":"/e/a"},
+      {"op":"add","path":"/","value":1},
+      {"op":"replace","path":"","value":[1]},
+      {"op":"test","path":"/0","value":2}
+   ])", &error));
+   QVERIFY(error.startsWith("operation 4"));
+   QCOMPARE(model.json(true), before);
+
+   QVERIFY(!model.applyPatch("[{\"op\":\"move\",\"from\":\"/a\",\"path\":\"/a/b/0\"}]"));
+   QVERIFY(!model.applyPatch("[{\"op\":\"remove\",\"path\":\"/a/b/01\"}]"));
+   QVERIFY(!model.applyPatch("[{\"op\":\"add\",\"path\":\"/a/b/5\",\"value\":5}]"));
+   QVERIFY(!model.applyPatch("[{\"op\":\"jump\",\"path\":\"/a\"}]"));
+   QVERIFY(!model.applyPatch("{}"));
+   QCOMPARE(model.json(true), before);
+   QCOMPARE(reset.count(), 0);
+
+   // values are restored as they were stored, not as value() rounds them
+   const QByteArray exact("[0.1000000000000000055511151231257827,1e400,9007199254740993,18446744073709551615]");
+   QVERIFY(model.loadFromRaw(exact));
+   QVERIFY(!model.applyPatch(R"([
+      {"op":"replace","path":"/0","value":1},
+      {"op":"replace","path":"/1","value":2},
+      {"op":"replace","path":"/2","value":3},
+      {"op":"replace","path":"/3","value":4},
+      {"op":"test","path":"/0","value":2}
+   ])"));
+   QCOMPARE(model.json(true), exact);
+
+   // a moved member gets its old key back
+   QVERIFY(model.loadFromRaw("{\"a\":1,\"c\":2}"));
+   QVERIFY(!model.applyPatch(R"([
+      {"op":"move","from":"/a","path":"/b"},
+      {"op":"test","path":"/b","value":2}
+   ])"));
+   QCOMPARE(model.json(true), QByteArray("{\"a\":1,\"c\":2}"));
+}
+
+void QJsonModelTest::mergePatch()
+{
+   QJsonModel model;
+   QVERIFY(model.loadFromRaw("{\"a\":\"b\",\"c\":{\"d\":\"e\",\"f\":\"g\"},\"h\":[1]}"));
+   auto tester = new QAbstractItemModelTester(&model, &model);
+   Q_UNUSED(tester)
+   QSignalSpy changed(&model, &QAbstractItemModel::dataChanged);
+   QSignalSpy removed(&model, &QAbstractItemModel::rowsRemoved);
+
+   QVERIFY(model.applyMergePatch(R"({"a":"z","c":{"f":null,"n":{"x":null,"y":1}},"h":{"k":null}})"));
+   QCOMPARE(model.json(true), QByteArray("{\"a\":\"z\",\"c\":{\"d\":\"e\",\"n\":{\"y\":1}},\"h\":{}}"));
+   QCOMPARE(changed.at(0).at(0).toModelIndex(), model.index(0, 1));
+   QCOMPARE(removed.count(), 2);
+
+   QVERIFY(model.applyMergePatch("[1,null]"));
+   QCOMPARE(model.json(true), QByteArray("[1,null]"));
+   QVERIFY(!model.applyMergePatch("true"));
+   QVERIFY(!model.applyMergePatch("{"));
+   QCOMPARE(model.json(true), QByteArray("[1,null]"));
+}
+
+void QJsonModelTest::reload()
+{
+   QJsonModel model;
+   QVERIFY(model.loadFromRaw(R"({"keep":{"x":[1,2]},"list":[{"id":1},{"id":2},{"id":3}],"value":1,"gone":true})"));
+   auto tester = new QAbstractItemModelTester(&model, &model);
+   Q_UNUSED(tester)
+   QSignalSpy reset(&model, &QAbstractItemModel::modelReset);
+   QSignalSpy changed(&model, &QAbstractItemModel::dataChanged);
+
+   const QPersistentModelIndex keep = model.index(1, 0);
+   const QPersistentModelIndex x = model.index(0, 0, keep);
+   const QPersistentModelIndex third = model.index(2, 0, model.index(2, 0));
+
+   // the third record moves to the front, the first one changes
+   const QByteArray next = R"({"keep":{"x":[1,2]},"list":[{"id":3},{"id":1,"new":0},{"id":2}],"value":"one","added":[]})";
+   QVERIFY(model.reloadFromRaw(next));
+   QCOMPARE(model.json(true), QJsonDocument::fromJson(next).toJson(QJsonDocument::Compact));
+   QCOMPARE(reset.count(), 0);
+   QVERIFY(keep.isValid());
+   QCOMPARE(x.data().toString(), QString("x"));
+   QCOMPARE(third.row(), 0);
+   QCOMPARE(model.index(3, 1).data().toString(), QString("one"));
+
+   changed.clear();
+   QVERIFY(model.reloadFromRaw(next));
+   QCOMPARE(changed.count(), 0);
+
+   QVERIFY(model.reloadFromRaw("[1,2]"));
+   QCOMPARE(model.json(true), QByteArray("[1,2]"));
+   QVERIFY(!model.reloadFromRaw("[1,"));
+   QCOMPARE(model.json(true), QByteArray("[1,2]"));
+
+   // lazy rows are fetched to be compared
+   QJsonModel lazy;
+   lazy.setLazyLoading(true);
+   QVERIFY(lazy.loadFromRaw("[[0,1],[2]]"));
+   QVERIFY(lazy.reloadFromRaw("[[0,1],[2,3]]"));
+   QCOMPARE(lazy.json(true), QByteArray("[[0,1],[2,3]]"));
+}
+
+void QJsonModelTest::pointer()
+{
+   QJsonModel model;
+   QVERIFY(model.loadFromRaw(R"({"a":{"b":[10,20,{"c/d":1,"e~f":2}]},"":0})"));
+   model.setKeyIndexThreshold(2);
+
+   const auto index = model.indexFromPointer("/a/b/2/c~1d", 1);
+   QCOMPARE(index.data().toDouble(), 1.0);
+   QCOMPARE(index.column(), 1);
+   QCOMPARE(model.pointerFromIndex(index), QString("/a/b/2/c~1d"));
+   QCOMPARE(model.pointerFromIndex(model.indexFromPointer("/a/b/2/e~0f")), QString("/a/b/2/e~0f"));
+   QCOMPARE(model.indexFromPointer("/").data().toString(), QString(""));
+   QCOMPARE(model.indexFromPointer("/a/b/1"), model.index(1, 0, model.index(0, 0, model.index(1, 0))));
+   QVERIFY(!model.indexFromPointer("").isValid());
+   QVERIFY(!model.indexFromPointer("a").isValid());
+   QVERIFY(!model.indexFromPointer("/a/b/3").isValid());
+   QVERIFY(!model.indexFromPointer("/a/b/01").isValid());
+   QVERIFY(!model.indexFromPointer("/a/x").isValid());
+   QCOMPARE(model.pointerFromIndex(QModelIndex()), QString());
+
+   // the index of an object follows its rows
+   const auto a = model.indexFromPointer("/a");
+   QVERIFY(model.insertMember(a, 0, "z", 3).isValid());
+   QCOMPARE(model.indexFromPointer("/a/z", 1).data().toDouble(), 3.0);
+   QVERIFY(model.removeRows(0, 1, a));
+   QVERIFY(!model.indexFromPointer("/a/z").isValid());
+   QVERIFY(model.indexFromPointer("/a/b").isValid());
+
+   QJsonModel lazy;
+   lazy.setLazyLoading(true);
+   lazy.setFetchBatchSize(1);
+   QVERIFY(lazy.loadFromRaw("[0,[1,{\"k\":true}]]"));
+   QCOMPARE(lazy.indexFromPointer("/1/1/k", 1).data().toBool(), true);
+}
+
+void QJsonModelTest::search()
+{
+   QJsonModel model;
+   QVERIFY(model.loadFromRaw(R"({"name":"Alpha","list":[{"name":"beta"},"alphabet",3],"alias":"gamma"})"));
+
+   auto keys = model.findKeys("name", Qt::MatchExactly);
+   QCOMPARE(keys.count(), 2);
+   QCOMPARE(model.pointerFromIndex(keys.at(0)), QString("/list/0/name"));
+   QCOMPARE(keys.at(0).column(), 0);
+   QCOMPARE(model.findKeys("al", Qt::MatchStartsWith).count(), 1);
+   QCOMPARE(model.findKeys("0").count(), 0);
+
+   QCOMPARE(model.findValues("alpha").count(), 2);
+   QCOMPARE(model.findValues("alpha", Qt::MatchContains | Qt::MatchCaseSensitive).count(), 1);
+   QCOMPARE(model.findValues("alpha", Qt::MatchContains, 1).count(), 1);
+   QCOMPARE(model.findValues("?eta", Qt::MatchWildcard).count(), 1);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+   const Qt::MatchFlags regExp = Qt::MatchRegularExpression;
+#else
+   const Qt::MatchFlags regExp = Qt::MatchRegExp;
+#endif
+   QCOMPARE(model.findValues("^\\d$", regExp).first().data().toDouble(), 3.0);
+
+   // exact matches ignore the case flag, as in match()
+   QCOMPARE(model.findValues("alpha", Qt::MatchExactly).count(), 0);
+   QCOMPARE(model.findValues("Alpha", Qt::MatchExactly).count(), 1);
+   QCOMPARE(model.findValues("alpha", Qt::MatchFixedString).count(), 1);
+
+   // the trigram index gives the same hits and follows edits
+   model.setSearchIndexEnabled(true);
+   QCOMPARE(model.findValues("alpha").count(), 2);
+   QCOMPARE(model.findKeys("lia").count(), 1);
+   const auto gamma = model.indexFromPointer("/alias", 1);
+   QVERIFY(model.setData(gamma, "alphanumeric"));
+   const auto found = model.findValues("alpha");
+   QCOMPARE(found.count(), 3);
+   QCOMPARE(model.pointerFromIndex(found.first()), QString("/alias"));
+   QCOMPARE(model.pointerFromIndex(found.last()), QString("/name"));
+   QCOMPARE(model.findValues("gamma").count(), 0);
+   QVERIFY(model.removeRows(0, 1, model.indexFromPointer("/list")));
+   QCOMPARE(model.findKeys("name").count(), 1);
+
+   QModelIndexList hits;
+   connect(&model, &QJsonModel::searchHits, this, [&](const QModelIndexList& found) { hits += found; });
+   QSignalSpy finished(&model, &QJsonModel::searchFinished);
+   model.startSearch("alpha");
+   QVERIFY(model.isSearching());
+   QVERIFY(finished.wait());
+   QCOMPARE(finished.first().first().toBool(), true);
+   QCOMPARE(hits.count(), 3);
+   QVERIFY(!model.isSearching());
+
+   model.startSearch("alpha");
+   model.cancelSearch();
+   QCOMPARE(finished.count(), 2);
+   QCOMPARE(finished.last().first().toBool(), false);
+
+   QJsonModel lazy;
+   lazy.setLazyLoading(true);
+   lazy.setFetchBatchSize(1);
+   QVERIFY(lazy.loadFromRaw(R"([[{"deep":"needle"}],"hay"])"));
+   QCOMPARE(lazy.findValues("needle").count(), 1);
+   QCOMPARE(lazy.findKeys("deep").first().parent().parent(), lazy.index(0, 0));
+}
+
+void QJsonModelTest::filterProxy()
+{
+   QJsonModel model;
+   QVERIFY(model.loadFromRaw(R"({"name":"root","items":[{"name":"a","size":1},{"name":"b","size":2}],"size":3})"));
+   QJsonFilterProxyModel proxy;
+   proxy.setSourceModel(&model);
+   auto tester = new QAbstractItemModelTester(&proxy, &proxy);
+   Q_UNUSED(tester)
+
+   QCOMPARE(proxy.rowCount(), 3);
+   QVERIFY(!proxy.isFiltered());
+
+   proxy.setFilterValue("b", Qt::MatchExactly);
+   QCOMPARE(proxy.matchCount(), 1);
+   QCOMPARE(proxy.rowCount(), 1);
+   const auto items = proxy.index(0, 0);
+   QCOMPARE(items.data().toString(), QString("items"));
+   QCOMPARE(proxy.rowCount(items), 1);
+   const auto name = proxy.index(0, 1, proxy.index(0, 0, items));
+   QCOMPARE(name.data().toString(), QString("b"));
+   QCOMPARE(model.pointerFromIndex(proxy.mapToSource(name)), QString("/items/1/name"));
+   QCOMPARE(proxy.mapFromSource(proxy.mapToSource(name)), name);
+   QVERIFY(!proxy.mapFromSource(model.indexFromPointer("/size")).isValid());
+
+   // edits show and hide rows without a reset
+   QSignalSpy reset(&proxy, &QAbstractItemModel::modelReset);
+   QVERIFY(model.setData(model.indexFromPointer("/items/0/name", 1), "b"));
+   QCOMPARE(proxy.rowCount(items), 2);
+   QCOMPARE(proxy.matchCount(), 2);
+   QVERIFY(model.setData(model.indexFromPointer("/items/1/name", 1), "c"));
+   QVERIFY(model.setData(model.indexFromPointer("/name", 1), "b"));
+   QCOMPARE(proxy.rowCount(), 2);
+   QCOMPARE(proxy.index(0, 0).data().toString(), QString("name"));
+   QVERIFY(model.setData(model.indexFromPointer("/items/0/name", 1), "c"));
+   QCOMPARE(proxy.rowCount(), 1);
+   QCOMPARE(reset.count(), 0);
+
+   proxy.clearFilters();
+   proxy.setFilterKey("size");
+   proxy.setFilterTypes({QJsonValue::Double});
+   QCOMPARE(proxy.matchCount(), 3);
+   proxy.setFilterPointer("/items/*/size");
+   QCOMPARE(proxy.matchCount(), 2);
+   QCOMPARE(proxy.rowCount(), 1);
+
+   // structural changes refilter
+   QVERIFY(model.removeRows(0, 1, model.indexFromPointer("/items")));
+   QCOMPARE(proxy.matchCount(), 1);
+   QVERIFY(model.loadFromRaw(R"({"items":[]})"));
+   QCOMPARE(proxy.rowCount(), 0);
+
+   QJsonModel lazy;
+   lazy.setLazyLoading(true);
+   lazy.setFetchBatchSize(1);
+   QVERIFY(lazy.loadFromRaw(R"([[{"deep":"needle"}],"hay"])"));
+   proxy.setSourceModel(&lazy);
+   proxy.clearFilters();
+   proxy.setFilterValue("needle");
+   QCOMPARE(proxy.rowCount(), 1);
+   QCOMPARE(proxy.rowCount(proxy.index(0, 0)), 1);
+}
+
+void QJsonModelTest::query()
+{
+   QJsonModel model;
+   QVERIFY(model.loadFromRaw(R"({"events":[{"level":"info","ts":1},{"level":"error","ts":2,"tags":["a"]},)"
+                             R"({"level":"error","ts":3},{"ts":4}],"limit":2,"it's":true})"));
+
+   const QJsonPath errors("$.events[?(@.level=='error')].ts");
+   QVERIFY(errors.isValid());
+   QCOMPARE(model.queryValues(errors), QJsonArray({2, 3}));
+   QCOMPARE(model.query(errors, 1).count(), 1);
+   QCOMPARE(model.pointerFromIndex(model.query(errors).last()), QString("/events/2/ts"));
+
+   auto values = [&model](const QString& expression) { return model.queryValues(QJsonPath(expression)); };
+   QCOMPARE(values("$.events[-1].ts"), QJsonArray({4}));
+   QCOMPARE(values("$.events[1:3].ts"), QJsonArray({2, 3}));
+   QCOMPARE(values("$.events[::-2].ts"), QJsonArray({4, 2}));
+   QCOMPARE(values("$['events'][0,3]['ts']"), QJsonArray({1, 4}));
+   QCOMPARE(values("$..tags[*]"), QJsonArray({"a"}));
+   QCOMPARE(values("$..ts").count(), 4);
+   QCOMPARE(values("$[\"it's\"]"), QJsonArray({true}));
+   QCOMPARE(values("$.events[?(@.ts > $.limit && !(@.level == 'error'))].ts"), QJsonArray({4}));
+   QCOMPARE(values("$.events[?(@.level != 'info')].ts"), QJsonArray({2, 3, 4}));
+   QCOMPARE(values("$.events[?(@.tags)].ts"), QJsonArray({2}));
+   QCOMPARE(values("$.events[?(@.level =~ /^ERR/i || @.ts <= 1)].ts"), QJsonArray({1, 2, 3}));
+   QCOMPARE(values("$.events[?(@.tags[0] == 'a')]").first().toObject().value("ts"), QJsonValue(2));
+   QCOMPARE(values("$").count(), 1);
+   QVERIFY(model.query(QJsonPath("$")).isEmpty());
+   QVERIFY(values("$.nothing.here").isEmpty());
+
+   for (const auto& invalid : {"events", "$.events[", "$.events[?(@.ts >)]", "$..", "$[1:2", "$[?(@.a == 'x)]"}) {
+      QVERIFY2(!QJsonPath(invalid).isValid(), invalid);
+      QVERIFY(!QJsonPath(invalid).errorString().isEmpty());
+   }
+
+   QJsonModel lazy;
+   lazy.setLazyLoading(true);
+   lazy.setFetchBatchSize(1);
+   QVERIFY(lazy.loadFromRaw(R"([[{"deep":"needle"}],"hay"])"));
+   QCOMPARE(lazy.query(QJsonPath("$[0][0].deep")).first().sibling(0, 1).data().toString(), QString("needle"));
+}
+
 
-QTEST_APPLESS_MAIN(QJsonModelTest)
+QTEST_GUILESS_MAIN(QJsonModelTest)
 
 #include "tst_qjsonmodeltest.moc"